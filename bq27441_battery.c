@@ -9,8 +9,14 @@
 #include <linux/slab.h>
 #include <linux/of.h>
 #include <linux/debugfs.h>
+#include <linux/ktime.h>
+#include <linux/atomic.h>
 
 #include "bq27xxx_battery.h"
+#include "bq27441_battery.h"
+
+#define CREATE_TRACE_POINTS
+#include "bq27441_trace.h"
 
 #define CONFIG_VERSION 7
 #define CONFIG_VERSION_FACTORY_RESET 0xFF
@@ -33,6 +39,8 @@
 #define BQ27441_RESET           0x0041
 #define BQ27441_SOFT_RESET      0x0042
 
+#define BQ27441_STATUS_HIBERNATE (1 << 6) /* CONTROL_STATUS */
+
 #define BQ27441_UNSEAL          0x8000
 
 #define BQ27441_CONTROL_1       0x00
@@ -76,6 +84,10 @@
 #define BQ27441_V_CHG_TERM_1        0x41
 #define BQ27441_V_CHG_TERM_2        0x42
 
+#define BQ27441_HIBERNATE_THRESHOLD_UA 3000 /* Default Hibernate I */
+#define BQ27441_HIBERNATE_DWELL_S      900  /* Time below Hibernate I first */
+#define BQ27441_HIBERNATE_POLL_INTERVAL 3600
+
 #define BQ27441_BATTERY_LOW   15
 #define BQ27441_BATTERY_FULL 100
 
@@ -311,12 +323,44 @@ static inline int control_write(struct bq27xxx_device_info *di, const u16 cmd)
 	return write_word(di, BQ27441_CONTROL_1, cmd);
 }
 
+/* Data memory block checksum: 255 minus the byte sum, modulo 256 */
+static u8 dm_checksum(const u8 *data, size_t len)
+{
+	u8 sum = 0;
+
+	while (len--)
+		sum += *data++;
+
+	return 0xff - sum;
+}
+
+/* Checksum of a block after @len bytes change from @old to @new */
+static u8 dm_checksum_update(u8 checksum, const u8 *old, const u8 *new,
+		size_t len)
+{
+	u8 sum = 0xff - checksum;
+	size_t i;
+
+	for (i = 0; i < len; i++)
+		sum += new[i] - old[i];
+
+	return 0xff - sum;
+}
+
 static inline int write_extended_cmd(struct bq27xxx_device_info *di,
 		const struct bq27441_extended_cmd *cmd)
 {
 	int ret;
 	u8 read_checksum;
 
+	/* A bad table entry would only show up after a 10 ms commit */
+	if (dm_checksum(cmd->command, sizeof(cmd->command)) != cmd->checksum) {
+		dev_warn(di->dev,
+				"Bad checksum %02x for %02X-%02X in config table\n",
+				cmd->checksum, cmd->datablock[0], cmd->datablock[1]);
+		return -EINVAL;
+	}
+
 	ret = write_array(di, BQ27441_DATA_BLOCK_CLASS, cmd->datablock,
 			sizeof(cmd->datablock));
 	if (ret < 0 || ret != sizeof(cmd->datablock) + 1) {
@@ -336,6 +380,8 @@ static inline int write_extended_cmd(struct bq27xxx_device_info *di,
 
 	ret = write_array(di, BQ27441_BLOCK_DATA_CHECKSUM, &cmd->checksum,
 			sizeof(cmd->checksum));
+	trace_bq27441_block_commit(di->dev, cmd->datablock[0],
+			cmd->datablock[1], cmd->checksum, ret);
 	if (ret < 0 || ret != sizeof(cmd->checksum) + 1) {
 		dev_warn(di->dev,
 				"Failed to write checksum to %02X-%02X (id: %u), ret %d\n",
@@ -363,6 +409,8 @@ static inline int write_extended_cmd(struct bq27xxx_device_info *di,
 	}
 
 	read_checksum = ret & 0xFF;
+	trace_bq27441_checksum_verify(di->dev, cmd->datablock[0],
+			cmd->datablock[1], cmd->checksum, read_checksum);
 	if (read_checksum != cmd->checksum) {
 		dev_warn(di->dev,
 				"Failed to write to %02X-%02X (id: %u), checksum %02x read back %02x\n",
@@ -371,7 +419,7 @@ static inline int write_extended_cmd(struct bq27xxx_device_info *di,
 		return -EINVAL;
 	}
 
-	dev_info(di->dev,
+	dev_dbg(di->dev,
 			"Happily wrote to %02X-%02X (id: %u)\n",
 			cmd->datablock[0], cmd->datablock[1], cmd->datablock[0]);
 
@@ -410,10 +458,14 @@ static inline int write_extended_byteorword(struct bq27xxx_device_info *di,
 	u8 read_checksum;
 	u8 old_data[2];
 	u8 new_data[2] = {data[0], single ? 0 : data[1]};
-	int new_checksum;
-	int temp_checksum;
+	u8 new_checksum;
 	u8 datablock = offset / 32;
 	u8 dataclassblock[] = {dataclass, datablock};
+	size_t len = single ? 1 : 2;
+
+	/* The second byte would land on the checksum register */
+	if (!single && offset % 32 == 31)
+		return -EINVAL;
 
 	ret = write_array(di, BQ27441_DATA_BLOCK_CLASS, dataclassblock,
 			sizeof(dataclassblock));
@@ -435,15 +487,15 @@ static inline int write_extended_byteorword(struct bq27xxx_device_info *di,
 	old_data[0] = ret & 0xff;
 	old_data[1] = single ? 0 : ((ret & 0xff00) >> 8);
 
-	temp_checksum = (255 - old_checksum - old_data[0] - old_data[1]) % 256;
-	new_checksum = 255 - ((temp_checksum + new_data[0] + new_data[1]) % 256);
-	new_checksum &= 0xFF;
+	new_checksum = dm_checksum_update(old_checksum, old_data, new_data, len);
 
-	ret = write_array(di, 0x40 + offset % 32, new_data, single ? 1 : 2);
+	ret = write_array(di, 0x40 + offset % 32, new_data, len);
 	if (ret < 0)
 		return ret;
 
 	ret = write_byte(di, BQ27441_BLOCK_DATA_CHECKSUM, new_checksum);
+	trace_bq27441_block_commit(di->dev, dataclass, datablock,
+			new_checksum, ret);
 	if (ret < 0)
 		return ret;
 
@@ -461,6 +513,8 @@ static inline int write_extended_byteorword(struct bq27xxx_device_info *di,
 		return ret;
 
 	read_checksum = ret & 0xFF;
+	trace_bq27441_checksum_verify(di->dev, dataclass, datablock,
+			new_checksum, read_checksum);
 	if (read_checksum != new_checksum) {
 		dev_warn(di->dev,
 				"Failed to write to %02X-%02X (id: %u), checksum %02x read back %02x\n",
@@ -469,14 +523,14 @@ static inline int write_extended_byteorword(struct bq27xxx_device_info *di,
 		return -EINVAL;
 	}
 
-	dev_info(di->dev,
+	dev_dbg(di->dev,
 			"Happily wrote to %02X-%02X (id: %u)\n",
 			dataclass, datablock, dataclass);
 
 	return 0;
 }
 
-static inline int config_mode_start(struct bq27xxx_device_info *di)
+static inline int __config_mode_start(struct bq27xxx_device_info *di)
 {
 	int ret;
 	int flags_lsb;
@@ -487,11 +541,11 @@ static inline int config_mode_start(struct bq27xxx_device_info *di)
 	if (ret < 0)
 		return ret;
 
-	dev_info(di->dev, "Flags: 0x%04x\n", ret);
+	dev_dbg(di->dev, "Flags: 0x%04x\n", ret);
 	flags_lsb = (ret & 0xff);
 
 	if (flags_lsb & BQ27441_FLAGS_CFGUPMODE) {
-		dev_info(di->dev, "Device already in config mode\n");
+		dev_dbg(di->dev, "Device already in config mode\n");
 		return 0;
 	}
 
@@ -501,7 +555,7 @@ static inline int config_mode_start(struct bq27xxx_device_info *di)
 	if (ret < 0)
 		return ret;
 
-	dev_info(di->dev, "Control status before unseal: 0x%04x\n", ret);
+	dev_dbg(di->dev, "Control status before unseal: 0x%04x\n", ret);
 	control_status = ret;
 
 	if (control_status & 0x2000) {
@@ -514,7 +568,7 @@ static inline int config_mode_start(struct bq27xxx_device_info *di)
 			return ret;
 	}
 	else
-		dev_info(di->dev, "Device already unsealed\n");
+		dev_dbg(di->dev, "Device already unsealed\n");
 
 	usleep_range(1000, 2000);
 
@@ -522,7 +576,7 @@ static inline int config_mode_start(struct bq27xxx_device_info *di)
 	if (ret < 0)
 		return ret;
 
-	dev_info(di->dev, "Control status after unseal: 0x%04x\n", ret);
+	dev_dbg(di->dev, "Control status after unseal: 0x%04x\n", ret);
 
 	/* Set fuel gauge in config mode */
 	ret = control_write(di, BQ27441_SET_CFGUPDATE);
@@ -538,7 +592,7 @@ static inline int config_mode_start(struct bq27xxx_device_info *di)
 			return ret;
 
 		flags_lsb = (ret & BQ27441_FLAGS_CFGUPMODE);
-		dev_info(di->dev, "flags_lsb %02x ret %02x\n", flags_lsb, ret);
+		dev_dbg(di->dev, "flags_lsb %02x ret %02x\n", flags_lsb, ret);
 
 		if (time_after(jiffies, timeout)) {
 			dev_warn(di->dev, "Timeout waiting for cfg update\n");
@@ -557,7 +611,16 @@ static inline int config_mode_start(struct bq27xxx_device_info *di)
 	return 0;
 }
 
-static inline int config_mode_stop(struct bq27xxx_device_info *di)
+static inline int config_mode_start(struct bq27xxx_device_info *di)
+{
+	int ret = __config_mode_start(di);
+
+	trace_bq27441_config_mode_enter(di->dev, ret);
+
+	return ret;
+}
+
+static inline int __config_mode_stop(struct bq27xxx_device_info *di)
 {
 	int ret;
 	int flags_lsb;
@@ -568,7 +631,7 @@ static inline int config_mode_stop(struct bq27xxx_device_info *di)
 		return ret;
 
 	if (ret & BQ27441_FLAGS_CFGUPMODE) {
-		dev_info(di->dev, "Exiting config mode by soft reset\n");
+		dev_dbg(di->dev, "Exiting config mode by soft reset\n");
 
 		ret = control_write(di, BQ27441_SOFT_RESET);
 		if (ret < 0)
@@ -602,6 +665,145 @@ static inline int config_mode_stop(struct bq27xxx_device_info *di)
 	return 0;
 }
 
+static inline int config_mode_stop(struct bq27xxx_device_info *di)
+{
+	int ret = __config_mode_stop(di);
+
+	trace_bq27441_config_mode_exit(di->dev, ret);
+
+	return ret;
+}
+
+/*
+ * Take di->lock for a maintenance operation such as a config session.
+ * While one is pending or running the core serves property reads from the
+ * last snapshot instead of blocking on the lock, and readers waiting for a
+ * refresh give up as soon as it starts. Config sessions sleep
+ * between data flash writes, so the bus path is held up for the whole
+ * session rather than left to autosuspend in between.
+ */
+static void maint_lock(struct bq27xxx_device_info *di)
+{
+	atomic_inc(&di->maint_active);
+	wake_up_all(&di->refresh_wait);
+	bq27xxx_pm_get(di);
+	bq27xxx_lock(di, BQ27XXX_LOCK_CONFIG);
+	di->maint_start = ktime_get();
+}
+
+static void maint_unlock(struct bq27xxx_device_info *di)
+{
+	s64 held_us = ktime_us_delta(ktime_get(), di->maint_start);
+
+	di->maint_last_us = held_us;
+	if (held_us > di->maint_max_us)
+		di->maint_max_us = held_us;
+	di->maint_count++;
+
+	bq27xxx_unlock(di);
+	bq27xxx_pm_put(di);
+	atomic_dec(&di->maint_active);
+}
+
+/*
+ * Power mode management
+ *
+ * Request hibernate once the average current has stayed below
+ * di->hibernate_threshold_ua for BQ27441_HIBERNATE_DWELL_S, and clear it
+ * again on load or charger events. The core stretches polling while the
+ * gauge hibernates and only calls in from the poll work, so the dwell is
+ * measured in time rather than in snapshots.
+ */
+static void set_power_mode(struct bq27xxx_device_info *di,
+		enum bq27xxx_power_mode mode)
+{
+	ktime_t now = ktime_get();
+
+	di->pm_mode_ms[di->pm_mode] += ktime_ms_delta(now, di->pm_mode_since);
+	di->pm_mode_since = now;
+	di->pm_transitions++;
+	WRITE_ONCE(di->pm_mode, mode);
+}
+
+static int power_mode_status(struct bq27xxx_device_info *di)
+{
+	struct bq27xxx_bus_group *group;
+	ktime_t start;
+	int ret;
+
+	bq27xxx_lock(di, BQ27XXX_LOCK_OTHER);
+	group = bq27xxx_bus_claim(di, &start);
+	ret = control_read(di, BQ27441_CONTROL_STATUS);
+	bq27xxx_bus_release(group, start);
+	bq27xxx_unlock(di);
+
+	return ret;
+}
+
+/* Mode changes are maintenance operations, and take their bus turn */
+static int power_mode_control(struct bq27xxx_device_info *di, u16 cmd)
+{
+	struct bq27xxx_bus_group *group;
+	ktime_t start;
+	int ret;
+
+	maint_lock(di);
+	group = bq27xxx_bus_claim(di, &start);
+	ret = control_write(di, cmd);
+	bq27xxx_bus_release(group, start);
+	maint_unlock(di);
+
+	return ret;
+}
+
+void bq27441_update_power_mode(struct bq27xxx_device_info *di,
+		int current_ua, bool wake)
+{
+	unsigned int threshold = READ_ONCE(di->hibernate_threshold_ua);
+	enum bq27xxx_power_mode mode;
+	ktime_t now = ktime_get();
+	bool low;
+	int ret;
+
+	if (di->chip != BQ27421)
+		return;
+
+	/* The gauge drops hibernate by itself on load; follow it */
+	ret = power_mode_status(di);
+	if (ret < 0) {
+		dev_warn(di->dev, "Unable to read control status, ret %d\n", ret);
+		return;
+	}
+	mode = ret & BQ27441_STATUS_HIBERNATE ?
+		BQ27XXX_PM_HIBERNATE : BQ27XXX_PM_NORMAL;
+	if (mode != di->pm_mode)
+		set_power_mode(di, mode);
+
+	low = !wake && threshold && abs(current_ua) < threshold;
+	if (low && !di->pm_low)
+		di->pm_low_since = now;
+	di->pm_low = low;
+
+	if (di->pm_mode == BQ27XXX_PM_NORMAL && low &&
+			ktime_ms_delta(now, di->pm_low_since) >=
+			BQ27441_HIBERNATE_DWELL_S * MSEC_PER_SEC) {
+		ret = power_mode_control(di, BQ27441_SET_HIBERNATE);
+		if (ret < 0) {
+			dev_warn(di->dev, "Unable to set hibernate, ret %d\n", ret);
+			return;
+		}
+		set_power_mode(di, BQ27XXX_PM_HIBERNATE);
+	} else if (di->pm_mode == BQ27XXX_PM_HIBERNATE && !low) {
+		ret = power_mode_control(di, BQ27441_CLEAR_HIBERNATE);
+		if (ret < 0) {
+			dev_warn(di->dev, "Unable to clear hibernate, ret %d\n", ret);
+			return;
+		}
+		set_power_mode(di, BQ27XXX_PM_NORMAL);
+	}
+}
+EXPORT_SYMBOL_GPL(bq27441_update_power_mode);
+
 #ifdef CONFIG_DEBUG_FS
 
 struct fsfile {
@@ -634,6 +836,18 @@ static ssize_t debugfs_factoryforce_show(struct file *fp, char __user *userbuf,
 		size_t count, loff_t *offset);
 static ssize_t debugfs_factoryforce_store(struct file *fp, const char __user *userbuf,
 		size_t count, loff_t *offset);
+static ssize_t debugfs_maint_show(struct file *fp, char __user *userbuf,
+		size_t count, loff_t *offset);
+static ssize_t debugfs_power_mode_show(struct file *fp, char __user *userbuf,
+		size_t count, loff_t *offset);
+static ssize_t debugfs_hibernate_threshold_show(struct file *fp,
+		char __user *userbuf, size_t count, loff_t *offset);
+static ssize_t debugfs_hibernate_threshold_store(struct file *fp,
+		const char __user *userbuf, size_t count, loff_t *offset);
+static ssize_t debugfs_hibernate_interval_show(struct file *fp,
+		char __user *userbuf, size_t count, loff_t *offset);
+static ssize_t debugfs_hibernate_interval_store(struct file *fp,
+		const char __user *userbuf, size_t count, loff_t *offset);
 
 static ssize_t debugfs_show_u16(struct file *fp, char __user *userbuf,
 		size_t count, loff_t *offset);
@@ -673,6 +887,10 @@ static const struct fsfile fsfiles[] = {
 		{.name = "DeltaVoltage",       .reg = 39, .dataclass = 82, FSFOPS_R(debugfs_show_ext_u16)},
 		{.name = "ForceFactoryConfig", .reg =  0, .dataclass =  0, FSFOPS_RW(debugfs_factoryforce_show, debugfs_factoryforce_store)},
 		{.name = "lowBat_polarity",    .reg =  0, .dataclass =  0, FSFOPS_RW(debugfs_polarity_show, debugfs_polarity_store)},
+		{.name = "MaintenanceHoldTime", .reg = 0, .dataclass =  0, FSFOPS_R(debugfs_maint_show)},
+		{.name = "PowerModeStats",     .reg =  0, .dataclass =  0, FSFOPS_R(debugfs_power_mode_show)},
+		{.name = "HibernateThreshold", .reg =  0, .dataclass =  0, FSFOPS_RW(debugfs_hibernate_threshold_show, debugfs_hibernate_threshold_store)},
+		{.name = "HibernatePollInterval", .reg = 0, .dataclass = 0, FSFOPS_RW(debugfs_hibernate_interval_show, debugfs_hibernate_interval_store)},
 };
 
 inline static int get_fsfile_match(const char *name)
@@ -703,10 +921,10 @@ static ssize_t debugfs_show_ext_byteorword(struct file *fp, char __user *userbuf
 	if (index < 0)
 		return index;
 
-	mutex_lock(&di->lock);
+	bq27xxx_lock(di, BQ27XXX_LOCK_DEBUGFS);
 	ret = read_extended_byteorword(di, fsfiles[index].dataclass,
 			fsfiles[index].reg, single);
-	mutex_unlock(&di->lock);
+	bq27xxx_unlock(di);
 
 	if (ret < 0)
 		return ret;
@@ -759,16 +977,8 @@ static ssize_t debugfs_store_ext_byteorword(struct file *fp, const char __user *
 	if (index < 0)
 		return index;
 
-	mutex_lock(&di->lock);
-	ret = config_mode_start(di);
-	if (ret < 0) {
-		mutex_unlock(&di->lock);
-		return ret;
-	}
-	ret = write_extended_byteorword(di, fsfiles[index].dataclass,
+	ret = bq27441_write_dm(di, fsfiles[index].dataclass,
 			fsfiles[index].reg, data, single);
-	mutex_unlock(&di->lock);
-
 	if (ret < 0)
 		return ret;
 
@@ -915,12 +1125,12 @@ static ssize_t debugfs_factoryforce_store(struct file *fp, const char __user *us
 	else
 		return -EINVAL;
 
-	mutex_lock(&di->lock);
+	maint_lock(di);
 	if (factoryforce)
 		ret = factory_reset(di);
 	else
 		ret = configure(di);
-	mutex_unlock(&di->lock);
+	maint_unlock(di);
 
 	if (ret >= 0)
 		return count;
@@ -939,9 +1149,9 @@ static ssize_t debugfs_factoryforce_show(struct file *fp, char __user *userbuf,
 	if (!di)
 		return -EIO;
 
-	mutex_lock(&di->lock);
+	bq27xxx_lock(di, BQ27XXX_LOCK_DEBUGFS);
 	ret = control_read(di, BQ27441_DM_CODE);
-	mutex_unlock(&di->lock);
+	bq27xxx_unlock(di);
 
 	if (ret < 0)
 		return ret;
@@ -964,7 +1174,7 @@ static inline int get_gpiopol(struct bq27xxx_device_info *di)
 	if (ret < 0)
 		return ret;
 
-	dev_info(di->dev, "%s triggered, opconfig_h(0x3b): 0x%02x\n", __func__, ret);
+	dev_dbg(di->dev, "%s triggered, opconfig_h(0x3b): 0x%02x\n", __func__, ret);
 
 	return (ret & BQ27441_OPCONF_GPIOPOL);
 }
@@ -975,7 +1185,7 @@ static inline int set_gpiopol(struct bq27xxx_device_info *di, bool status)
 	u8 opconfig1;
 	u8 old_opconfig1;
 
-	dev_info(di->dev, "set_gpiopol triggered\n");
+	dev_dbg(di->dev, "set_gpiopol triggered\n");
 
 	ret = config_mode_start(di);
 	if (ret < 0) {
@@ -1025,9 +1235,9 @@ static ssize_t debugfs_polarity_store(struct file *fp, const char __user *userbu
 	else
 		return -EINVAL;
 
-	mutex_lock(&di->lock);
+	maint_lock(di);
 	ret = set_gpiopol(di, status);
-	mutex_unlock(&di->lock);
+	maint_unlock(di);
 
 	if (ret >= 0)
 		return count;
@@ -1043,14 +1253,14 @@ static ssize_t debugfs_polarity_show(struct file *fp, char __user *userbuf,
 	struct bq27xxx_device_info *di = fp->private_data;
 	char buf[4] = {0};
 
-	dev_info(di->dev, "polarity_debugfs_show count %zu\n", count);
+	dev_dbg(di->dev, "polarity_debugfs_show count %zu\n", count);
 
 	if (!di)
 		return -EIO;
 
-	mutex_lock(&di->lock);
+	bq27xxx_lock(di, BQ27XXX_LOCK_DEBUGFS);
 	ret = get_gpiopol(di);
-	mutex_unlock(&di->lock);
+	bq27xxx_unlock(di);
 
 	if (ret < 0)
 		return ret;
@@ -1064,11 +1274,132 @@ static ssize_t debugfs_polarity_show(struct file *fp, char __user *userbuf,
 	return simple_read_from_buffer(userbuf, count, offset, buf, ret);
 }
 
+static ssize_t debugfs_maint_show(struct file *fp, char __user *userbuf,
+		size_t count, loff_t *offset)
+{
+	int ret;
+	struct bq27xxx_device_info *di = fp->private_data;
+	char buf[80] = {0};
+
+	if (!di)
+		return -EIO;
+
+	ret = scnprintf(buf, sizeof(buf) - 1,
+			"last_us %lld\nmax_us %lld\ncount %u\n",
+			di->maint_last_us, di->maint_max_us, di->maint_count);
+
+	return simple_read_from_buffer(userbuf, count, offset, buf, ret);
+}
+
+static ssize_t debugfs_power_mode_show(struct file *fp, char __user *userbuf,
+		size_t count, loff_t *offset)
+{
+	int ret;
+	struct bq27xxx_device_info *di = fp->private_data;
+	char buf[128] = {0};
+	s64 mode_ms[BQ27XXX_PM_MODES];
+	enum bq27xxx_power_mode mode;
+
+	if (!di)
+		return -EIO;
+
+	bq27xxx_lock(di, BQ27XXX_LOCK_DEBUGFS);
+	mode = di->pm_mode;
+	memcpy(mode_ms, di->pm_mode_ms, sizeof(mode_ms));
+	mode_ms[mode] += ktime_ms_delta(ktime_get(), di->pm_mode_since);
+	bq27xxx_unlock(di);
+
+	ret = scnprintf(buf, sizeof(buf) - 1,
+			"mode %s\nnormal_ms %lld\nhibernate_ms %lld\ntransitions %u\n",
+			mode == BQ27XXX_PM_HIBERNATE ? "hibernate" : "normal",
+			mode_ms[BQ27XXX_PM_NORMAL], mode_ms[BQ27XXX_PM_HIBERNATE],
+			di->pm_transitions);
+
+	return simple_read_from_buffer(userbuf, count, offset, buf, ret);
+}
+
+static ssize_t hibernate_setting_show(const unsigned int *setting,
+		char __user *userbuf, size_t count, loff_t *offset)
+{
+	int ret;
+	char buf[16] = {0};
+
+	ret = scnprintf(buf, sizeof(buf) - 1, "%u\n", READ_ONCE(*setting));
+
+	return simple_read_from_buffer(userbuf, count, offset, buf, ret);
+}
+
+static ssize_t hibernate_setting_store(unsigned int *setting,
+		const char __user *userbuf, size_t count)
+{
+	int ret;
+	unsigned int value;
+
+	ret = kstrtouint_from_user(userbuf, count, 0, &value);
+	if (ret)
+		return ret;
+
+	WRITE_ONCE(*setting, value);
+
+	return count;
+}
+
+/* Hibernate I, in uA */
+static ssize_t debugfs_hibernate_threshold_show(struct file *fp,
+		char __user *userbuf, size_t count, loff_t *offset)
+{
+	struct bq27xxx_device_info *di = fp->private_data;
+
+	if (!di)
+		return -EIO;
+
+	return hibernate_setting_show(&di->hibernate_threshold_ua, userbuf,
+			count, offset);
+}
+
+static ssize_t debugfs_hibernate_threshold_store(struct file *fp,
+		const char __user *userbuf, size_t count, loff_t *offset)
+{
+	struct bq27xxx_device_info *di = fp->private_data;
+
+	if (!di)
+		return -EIO;
+
+	return hibernate_setting_store(&di->hibernate_threshold_ua, userbuf,
+			count);
+}
+
+/* Poll interval while hibernating, in s */
+static ssize_t debugfs_hibernate_interval_show(struct file *fp,
+		char __user *userbuf, size_t count, loff_t *offset)
+{
+	struct bq27xxx_device_info *di = fp->private_data;
+
+	if (!di)
+		return -EIO;
+
+	return hibernate_setting_show(&di->hibernate_poll_interval, userbuf,
+			count, offset);
+}
+
+static ssize_t debugfs_hibernate_interval_store(struct file *fp,
+		const char __user *userbuf, size_t count, loff_t *offset)
+{
+	struct bq27xxx_device_info *di = fp->private_data;
+
+	if (!di)
+		return -EIO;
+
+	return hibernate_setting_store(&di->hibernate_poll_interval, userbuf,
+			count);
+}
+
 static int bq27441_create_debugfs(struct bq27xxx_device_info *di)
 {
 	int i;
 
-	di->dfs_dir = debugfs_create_dir("bq27441", NULL);
+	/* Per device, next to the core files, so several gauges can coexist */
+	di->dfs_dir = debugfs_create_dir("bq27441", di->dfs_dev_dir);
 
 	for (i = 0; i < ARRAY_SIZE(fsfiles); i++) {
 		debugfs_create_file(fsfiles[i].name, fsfiles[i].mode, di->dfs_dir,
@@ -1192,38 +1523,89 @@ static int configure(struct bq27xxx_device_info *di)
 		dev_warn(di->dev, "Unable to read back BQ27441_DM_CODE, ret %d\n", ret);
 		return ret;
 	}
-	dev_info(di->dev, "BQ27441_DM_CODE read back %04X\n", ret);
+	dev_dbg(di->dev, "BQ27441_DM_CODE read back %04X\n", ret);
 
 	ret = config_mode_stop(di);
 	return ret;
 }
 
+/*
+ * Maintenance entry points. Each one runs as a single maintenance
+ * operation; they back the debugfs files and the simulator benchmarks.
+ */
+int bq27441_configure(struct bq27xxx_device_info *di)
+{
+	int ret;
+
+	maint_lock(di);
+	ret = configure(di);
+	maint_unlock(di);
+
+	return ret;
+}
+EXPORT_SYMBOL_GPL(bq27441_configure);
+
+int bq27441_config_mode(struct bq27xxx_device_info *di, bool enter)
+{
+	int ret;
+
+	maint_lock(di);
+	ret = enter ? config_mode_start(di) : config_mode_stop(di);
+	maint_unlock(di);
+
+	return ret;
+}
+EXPORT_SYMBOL_GPL(bq27441_config_mode);
+
+/* Leaves the gauge in config mode, like the data memory debugfs files */
+int bq27441_write_dm(struct bq27xxx_device_info *di, u8 dataclass,
+		u8 offset, const u8 *data, bool single)
+{
+	int ret;
+
+	maint_lock(di);
+	ret = config_mode_start(di);
+	if (ret >= 0)
+		ret = write_extended_byteorword(di, dataclass, offset, data,
+				single);
+	maint_unlock(di);
+
+	return ret;
+}
+EXPORT_SYMBOL_GPL(bq27441_write_dm);
+
 int bq27441_init(struct bq27xxx_device_info *di)
 {
 	int ret;
 	bool itpor;
 	u8 dmcode;
 
-	mutex_lock(&di->lock);
+	maint_lock(di);
 
 	ret = check_fw_version(di);
+	bq27xxx_probe_mark(di, BQ27XXX_PROBE_FW_VERSION);
 	if (ret < 0)
 		goto done;
 
+	di->hibernate_threshold_ua = BQ27441_HIBERNATE_THRESHOLD_UA;
+	di->hibernate_poll_interval = BQ27441_HIBERNATE_POLL_INTERVAL;
+
 #ifdef CONFIG_DEBUG_FS
 	if (bq27441_create_debugfs(di) < 0)
 		dev_warn(di->dev, "Failed to create debugfs\n");
 #endif /* CONFIG_DEBUG_FS */
 
 	ret = read_byte(di, BQ27441_FLAGS);
+	bq27xxx_probe_mark(di, BQ27XXX_PROBE_FLAGS);
 	if (ret < 0) {
 		dev_warn(di->dev, "Unable to read BQ27441_FLAGS, ret %d\n", ret);
 		goto done;
 	}
 	itpor = (ret & BQ27441_FLAGS_ITPOR);
-	dev_info(di->dev, "ITPOR bit: %c", itpor ? '1' : '0');
+	dev_dbg(di->dev, "ITPOR bit: %c\n", itpor ? '1' : '0');
 
 	ret = control_read(di, BQ27441_DM_CODE);
+	bq27xxx_probe_mark(di, BQ27XXX_PROBE_DM_CODE);
 	if (ret < 0) {
 		dev_warn(di->dev, "Unable to read BQ27441_DM_CODE, ret %d\n", ret);
 		goto done;
@@ -1235,9 +1617,10 @@ int bq27441_init(struct bq27xxx_device_info *di)
 		goto done;
 	else if (dmcode != CONFIG_VERSION || itpor)
 		ret = configure(di);
+	bq27xxx_probe_mark(di, BQ27XXX_PROBE_CONFIGURE);
 
 done:
-	mutex_unlock(&di->lock);
+	maint_unlock(di);
 
 	if (ret < 0)
 		dev_warn(di->dev, "Failed to initialize\n");
@@ -1250,10 +1633,15 @@ void bq27441_exit(struct bq27xxx_device_info *di)
 {
 #ifdef CONFIG_DEBUG_FS
 	debugfs_remove_recursive(di->dfs_dir);
+	di->dfs_dir = NULL;
 #endif /* CONFIG_DEBUG_FS */
 }
 EXPORT_SYMBOL_GPL(bq27441_exit);
 
+#ifdef CONFIG_BQ27441_KUNIT_TEST
+#include "bq27441_test.c"
+#endif /* CONFIG_BQ27441_KUNIT_TEST */
+
 MODULE_AUTHOR("Lars <lars.ivar.miljeteig@remarkable.no>");
 MODULE_DESCRIPTION("BQ27441 battery monitor driver");
 MODULE_LICENSE("GPL");
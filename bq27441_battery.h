@@ -2,6 +2,12 @@
 #define _BQ27441_BATTERY_H
 
 int bq27441_init(struct bq27xxx_device_info *di);
-int bq27441_exit(struct bq27xxx_device_info *di);
+void bq27441_exit(struct bq27xxx_device_info *di);
+void bq27441_update_power_mode(struct bq27xxx_device_info *di,
+			       int current_ua, bool wake);
+int bq27441_configure(struct bq27xxx_device_info *di);
+int bq27441_config_mode(struct bq27xxx_device_info *di, bool enter);
+int bq27441_write_dm(struct bq27xxx_device_info *di, u8 dataclass,
+		     u8 offset, const u8 *data, bool single);
 
 #endif /* _BQ27441_BATTERY_H */
@@ -0,0 +1,1236 @@
+/*
+ * Simulated bq27441 fuel gauge
+ *
+ * Registers a "bq27441-sim" battery whose bus accessors talk to a
+ * software model of the gauge instead of an I2C client, so the core and
+ * bq27441 code paths (probe, configure(), updates, debugfs) can be run
+ * and timed on a machine without the hardware.
+ *
+ * The model covers the standard commands, the control subcommands the
+ * driver uses, the sealed/unsealed and CFGUPDATE states and data memory
+ * blocks with their checksums. Bus, flash commit and mode change delays
+ * are set from debugfs under bq27441-sim/.
+ *
+ * The "bench" file there runs key driver operations against the model
+ * and checks their bus transactions, bytes and sleep time against the
+ * budgets below, so changes that add bus traffic are caught.
+ *
+ * Bus faults can be injected as well: latency jitter and clock
+ * stretching, NACKs, torn 16-bit reads and a window after resets in
+ * which the gauge reads back 0xFF and NACKs writes. Together with a slow
+ * cfg_delay_us this shows how updates and config sessions behave on a
+ * bad bus; budgets are not expected to hold while faults are enabled.
+ *
+ * With replay=<firmware file>, a trace recorded from
+ * bq27xxx/devices/<battery>/bus_trace_data is fed back to the driver:
+ * each transaction is served from the next matching record, and the
+ * model only answers what the trace does not cover. replay_status counts
+ * where the driver diverged from the recording; recording again while
+ * replaying gives a trace to compare with the original.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+
+#include <linux/device.h>
+#include <linux/module.h>
+#include <linux/platform_device.h>
+#include <linux/power_supply.h>
+#include <linux/slab.h>
+#include <linux/delay.h>
+#include <linux/debugfs.h>
+#include <linux/ktime.h>
+#include <linux/mutex.h>
+#include <linux/sched.h>
+#include <linux/seq_file.h>
+#include <linux/random.h>
+#include <linux/firmware.h>
+#include <asm/unaligned.h>
+
+#include "bq27xxx_battery.h"
+#include "bq27441_battery.h"
+#include "bq27xxx_snapshot.h"
+
+#define SIM_CONTROL		0x00
+#define SIM_TEMPERATURE		0x02
+#define SIM_VOLTAGE		0x04
+#define SIM_FLAGS		0x06
+#define SIM_NOMINAL_AVAIL_CAP	0x08
+#define SIM_FULL_AVAIL_CAP	0x0a
+#define SIM_REMAINING_CAP	0x0c
+#define SIM_FULL_CHG_CAP	0x0e
+#define SIM_AVG_CURRENT		0x10
+#define SIM_AVG_POWER		0x18
+#define SIM_SOC			0x1c
+#define SIM_INT_TEMPERATURE	0x1e
+#define SIM_SOH			0x20
+#define SIM_OPCONFIG		0x3a
+#define SIM_DESIGN_CAP		0x3c
+#define SIM_DATA_CLASS		0x3e
+#define SIM_DATA_BLOCK		0x3f
+#define SIM_BLOCK_DATA		0x40
+#define SIM_BLOCK_CHECKSUM	0x60
+#define SIM_BLOCK_CONTROL	0x61
+#define SIM_STD_REGS		0x40
+
+#define SIM_FLAGS_CFGUPMODE	(1 << 4)
+#define SIM_FLAGS_ITPOR		(1 << 5)
+
+#define SIM_STATUS_HIBERNATE	(1 << 6)
+#define SIM_STATUS_SS		(1 << 13)
+
+#define SIM_CONTROL_STATUS	0x0000
+#define SIM_DEVICE_TYPE		0x0001
+#define SIM_FW_VERSION		0x0002
+#define SIM_DM_CODE		0x0004
+#define SIM_CHEM_ID		0x0008
+#define SIM_SET_HIBERNATE	0x0011
+#define SIM_CLEAR_HIBERNATE	0x0012
+#define SIM_SET_CFGUPDATE	0x0013
+#define SIM_SEALED		0x0020
+#define SIM_RESET		0x0041
+#define SIM_SOFT_RESET		0x0042
+#define SIM_UNSEAL_KEY		0x8000
+
+#define SIM_DM_CLASSES		128
+#define SIM_DM_BLOCKS		4
+#define SIM_BLOCK_SIZE		32
+
+/* Data memory class and offset of the OpConfig word and the DM code */
+#define SIM_DM_REGISTERS	64
+#define SIM_DM_CODE_OFFSET	3
+
+/*
+ * Parameters the bench rewrites with their configured values: SOC1 Set
+ * Threshold (a byte in block 0) and V at Chg Term (a big endian word in
+ * block 1).
+ */
+#define SIM_BENCH_DM_CLASS	49
+#define SIM_BENCH_DM_OFFSET	0
+#define SIM_BENCH_DM_VALUE	10
+#define SIM_BENCH_DM_WORD_CLASS		82
+#define SIM_BENCH_DM_WORD_OFFSET	33
+#define SIM_BENCH_DM_WORD_VALUE		4190
+
+#define SIM_BENCH_NR_PROPS	12
+#define SIM_BENCH_SLACK_US	10000
+
+/* Records skipped at most to resync after the driver diverges */
+#define SIM_REPLAY_LOOKAHEAD	16
+
+enum sim_bench_op {
+	SIM_BENCH_UPDATE = 0,
+	SIM_BENCH_PROPS,
+	SIM_BENCH_PROPS_STALE,
+	SIM_BENCH_CONFIG_ENTER,
+	SIM_BENCH_CONFIG_EXIT,
+	SIM_BENCH_DM_WRITE,
+	SIM_BENCH_DM_WRITE_WORD,
+	SIM_BENCH_CONFIGURE,
+	SIM_BENCH_OPS,
+};
+
+static const char * const sim_bench_names[SIM_BENCH_OPS] = {
+	[SIM_BENCH_UPDATE] = "update",
+	[SIM_BENCH_PROPS] = "props",
+	[SIM_BENCH_PROPS_STALE] = "props_stale",
+	[SIM_BENCH_CONFIG_ENTER] = "config_enter",
+	[SIM_BENCH_CONFIG_EXIT] = "config_exit",
+	[SIM_BENCH_DM_WRITE] = "dm_write",
+	[SIM_BENCH_DM_WRITE_WORD] = "dm_write_word",
+	[SIM_BENCH_CONFIGURE] = "configure",
+};
+
+/*
+ * Sleep budgets are the sum of the usleep_range() upper bounds on the
+ * path; transactions and bytes must match exactly or be lower. Bytes
+ * count the register address, as on I2C.
+ */
+struct sim_budget {
+	unsigned int tx;
+	unsigned int bytes;
+	unsigned int sleep_us;
+};
+
+static const struct sim_budget sim_budgets[SIM_BENCH_OPS] = {
+	/*
+	 * One steady-state update, design capacity already known. Only
+	 * the bq27421 register map is modelled, so only that chip class
+	 * runs this one.
+	 */
+	[SIM_BENCH_UPDATE] = { 9, 27, 0 },
+	[SIM_BENCH_PROPS] = { 0, 0, 0 },
+	[SIM_BENCH_PROPS_STALE] = { 0, 0, 0 },
+	[SIM_BENCH_CONFIG_ENTER] = { 8, 22, 5200 },
+	[SIM_BENCH_CONFIG_EXIT] = { 3, 7, 2200 },
+	[SIM_BENCH_DM_WRITE] = { 15, 38, 21000 },
+	[SIM_BENCH_DM_WRITE_WORD] = { 15, 40, 21000 },
+	[SIM_BENCH_CONFIGURE] = { 97, 672, 193000 },
+};
+
+struct sim_result {
+	bool valid;
+	bool pass;
+	int ret;
+	u64 tx;
+	u64 bytes;
+	u64 errors;
+	u64 bus_us;
+	u64 sleep_us;
+	struct sim_budget budget;
+};
+
+struct bq27441_sim {
+	struct bq27xxx_device_info di;
+	struct mutex lock;
+	enum bq27xxx_chip chip;		/* as presented to the core */
+
+	u16 regs[SIM_STD_REGS / 2];	/* standard commands, in CPU order */
+	u16 control_status;
+	u16 control_resp;
+	bool unseal_armed;
+
+	bool cfgupdate;
+	bool cfg_pending;
+	ktime_t cfg_change_at;
+
+	u8 dm_class;
+	u8 dm_block;
+	u8 block[SIM_BLOCK_SIZE];
+	u8 dm[SIM_DM_CLASSES][SIM_DM_BLOCKS][SIM_BLOCK_SIZE];
+
+	u32 read_delay_us;
+	u32 write_delay_us;
+	u32 commit_delay_us;
+	u32 cfg_delay_us;
+
+	u64 commits;
+	u64 commits_rejected;
+
+	/* Fault injection; probabilities are in parts per thousand */
+	u32 jitter_us;
+	u32 stretch_us;
+	u32 stretch_permille;
+	u32 nack_permille;
+	u32 torn_permille;
+	u32 reset_busy_us;
+	ktime_t busy_until;
+	u64 injected_stretch;
+	u64 injected_nacks;
+	u64 injected_torn;
+	u64 injected_busy;
+
+	/* Recorded trace being replayed, if any */
+	const struct firmware *replay_fw;
+	size_t replay_pos;		/* offset of the next record */
+	size_t replay_end;		/* end of the last whole record */
+	u64 replay_index;		/* and its index */
+	u64 replay_records;
+	u64 replay_matched;
+	u64 replay_skipped;
+	u64 replay_diverged;
+	s64 replay_first_divergence;	/* record index, or -1 */
+	bool replay_timing;
+
+	/* Traffic issued by bench_task only; other callers are not counted */
+	struct mutex bench_lock;
+	struct task_struct *bench_task;
+	u64 bench_tx;
+	u64 bench_bytes;
+	u64 bench_errors;
+	u64 bench_bus_ns;
+	u32 bench_slack_us;
+	struct sim_result results[SIM_BENCH_OPS];
+
+	struct dentry *dfs_dir;
+};
+
+static struct platform_device *bq27441_sim_pdev;
+
+static unsigned int dm_code;
+module_param(dm_code, uint, 0444);
+MODULE_PARM_DESC(dm_code, "DM code reported at power on (default: 0, unconfigured)");
+
+static unsigned int chip = BQ27421;
+module_param(chip, uint, 0444);
+MODULE_PARM_DESC(chip, "Chip class presented to the core (default: BQ27421)");
+
+static bool bench;
+module_param(bench, bool, 0444);
+MODULE_PARM_DESC(bench, "Run the benchmarks once after probe (default: false)");
+
+static bool sealed = true;
+module_param(sealed, bool, 0444);
+MODULE_PARM_DESC(sealed, "Start in the sealed state (default: true)");
+
+static char *replay;
+module_param(replay, charp, 0444);
+MODULE_PARM_DESC(replay, "Firmware file with a bus trace to replay (default: none)");
+
+static inline struct bq27441_sim *to_sim(struct bq27xxx_device_info *di)
+{
+	return container_of(di, struct bq27441_sim, di);
+}
+
+static u8 sim_checksum(const u8 *block)
+{
+	unsigned int sum = 0;
+	int i;
+
+	for (i = 0; i < SIM_BLOCK_SIZE; i++)
+		sum += block[i];
+
+	return 255 - (sum & 0xff);
+}
+
+static void sim_load_block(struct bq27441_sim *sim)
+{
+	/* Data memory reads back as zeroes while sealed */
+	if ((sim->control_status & SIM_STATUS_SS) ||
+	    sim->dm_class >= SIM_DM_CLASSES || sim->dm_block >= SIM_DM_BLOCKS) {
+		memset(sim->block, 0, sizeof(sim->block));
+		return;
+	}
+
+	memcpy(sim->block, sim->dm[sim->dm_class][sim->dm_block],
+	       sizeof(sim->block));
+}
+
+/* OpConfig is stored big endian in data memory */
+static void sim_sync_opconfig(struct bq27441_sim *sim)
+{
+	const u8 *regs = sim->dm[SIM_DM_REGISTERS][0];
+
+	sim->regs[SIM_OPCONFIG / 2] = (regs[0] << 8) | regs[1];
+}
+
+static void sim_power_on(struct bq27441_sim *sim)
+{
+	memset(sim->regs, 0, sizeof(sim->regs));
+	memset(sim->dm, 0, sizeof(sim->dm));
+
+	/*
+	 * Other chip classes map their registers elsewhere; they read the
+	 * standard commands as zeroes and only see the control interface.
+	 */
+	if (sim->chip != BQ27421) {
+		sim->regs[SIM_FLAGS / 2] = SIM_FLAGS_ITPOR;
+		goto out;
+	}
+
+	sim->regs[SIM_TEMPERATURE / 2] = 2982;		/* 25.0 C in 0.1 K */
+	sim->regs[SIM_VOLTAGE / 2] = 3850;
+	sim->regs[SIM_FLAGS / 2] = SIM_FLAGS_ITPOR;
+	sim->regs[SIM_NOMINAL_AVAIL_CAP / 2] = 1300;
+	sim->regs[SIM_FULL_AVAIL_CAP / 2] = 2000;
+	sim->regs[SIM_REMAINING_CAP / 2] = 1300;
+	sim->regs[SIM_FULL_CHG_CAP / 2] = 2000;
+	sim->regs[SIM_AVG_CURRENT / 2] = (u16)-250;
+	sim->regs[SIM_AVG_POWER / 2] = (u16)-960;
+	sim->regs[SIM_SOC / 2] = 65;
+	sim->regs[SIM_INT_TEMPERATURE / 2] = 2982;
+	sim->regs[SIM_SOH / 2] = 0x0300 | 100;
+	sim->regs[SIM_DESIGN_CAP / 2] = 2000;
+
+out:
+	sim->dm[SIM_DM_REGISTERS][0][SIM_DM_CODE_OFFSET] = dm_code;
+	sim_sync_opconfig(sim);
+
+	sim->control_status = sealed ? SIM_STATUS_SS : 0;
+	sim->control_resp = 0;
+	sim->unseal_armed = false;
+	sim->cfgupdate = false;
+	sim->cfg_pending = false;
+	sim->dm_class = 0;
+	sim->dm_block = 0;
+	sim_load_block(sim);
+}
+
+/* Apply a pending CFGUPDATE entry or exit once its delay has passed */
+static void sim_settle(struct bq27441_sim *sim)
+{
+	if (!sim->cfg_pending || ktime_before(ktime_get(), sim->cfg_change_at))
+		return;
+
+	sim->cfg_pending = false;
+	sim->cfgupdate = !sim->cfgupdate;
+	if (sim->cfgupdate) {
+		sim->regs[SIM_FLAGS / 2] |= SIM_FLAGS_CFGUPMODE;
+	} else {
+		sim->regs[SIM_FLAGS / 2] &= ~(SIM_FLAGS_CFGUPMODE |
+					      SIM_FLAGS_ITPOR);
+		sim_sync_opconfig(sim);
+	}
+}
+
+static void sim_cfg_change(struct bq27441_sim *sim)
+{
+	sim->cfg_pending = true;
+	sim->cfg_change_at = ktime_add_us(ktime_get(), sim->cfg_delay_us);
+	sim_settle(sim);
+}
+
+static void sim_control(struct bq27441_sim *sim, u16 subcmd)
+{
+	bool armed = sim->unseal_armed;
+
+	sim->unseal_armed = false;
+	sim->control_resp = 0;
+
+	switch (subcmd) {
+	case SIM_CONTROL_STATUS:
+		sim->control_resp = sim->control_status;
+		break;
+	case SIM_DEVICE_TYPE:
+		sim->control_resp = 0x0421;
+		break;
+	case SIM_FW_VERSION:
+		sim->control_resp = 0x0109;
+		break;
+	case SIM_DM_CODE:
+		sim->control_resp =
+			sim->dm[SIM_DM_REGISTERS][0][SIM_DM_CODE_OFFSET];
+		break;
+	case SIM_CHEM_ID:
+		sim->control_resp = 0x0128;
+		break;
+	case SIM_SET_HIBERNATE:
+		sim->control_status |= SIM_STATUS_HIBERNATE;
+		break;
+	case SIM_CLEAR_HIBERNATE:
+		sim->control_status &= ~SIM_STATUS_HIBERNATE;
+		break;
+	case SIM_SET_CFGUPDATE:
+		if (!(sim->control_status & SIM_STATUS_SS) &&
+		    !sim->cfgupdate && !sim->cfg_pending)
+			sim_cfg_change(sim);
+		break;
+	case SIM_SOFT_RESET:
+		if (sim->cfgupdate && !sim->cfg_pending)
+			sim_cfg_change(sim);
+		sim->busy_until = ktime_add_us(ktime_get(), sim->reset_busy_us);
+		break;
+	case SIM_SEALED:
+		sim->control_status |= SIM_STATUS_SS;
+		break;
+	case SIM_RESET:
+		/* Data memory lives in RAM; a full reset reloads the defaults */
+		sim_power_on(sim);
+		sim->busy_until = ktime_add_us(ktime_get(), sim->reset_busy_us);
+		break;
+	case SIM_UNSEAL_KEY:
+		if (armed)
+			sim->control_status &= ~SIM_STATUS_SS;
+		else
+			sim->unseal_armed = true;
+		break;
+	default:
+		break;
+	}
+}
+
+static u8 sim_read_byte(struct bq27441_sim *sim, u8 reg)
+{
+	if (reg <= SIM_CONTROL + 1)
+		return reg & 1 ? sim->control_resp >> 8 : sim->control_resp;
+	if (reg == SIM_DATA_CLASS)
+		return sim->dm_class;
+	if (reg == SIM_DATA_BLOCK)
+		return sim->dm_block;
+	if (reg < SIM_STD_REGS)
+		return reg & 1 ? sim->regs[reg / 2] >> 8 : sim->regs[reg / 2];
+	if (reg < SIM_BLOCK_CHECKSUM)
+		return sim->block[reg - SIM_BLOCK_DATA];
+	if (reg == SIM_BLOCK_CHECKSUM)
+		return sim_checksum(sim->block);
+
+	return 0;
+}
+
+static void sim_commit(struct bq27441_sim *sim, u8 checksum)
+{
+	if (!sim->cfgupdate || (sim->control_status & SIM_STATUS_SS) ||
+	    sim->dm_class >= SIM_DM_CLASSES || sim->dm_block >= SIM_DM_BLOCKS ||
+	    checksum != sim_checksum(sim->block)) {
+		/* The gauge drops the block; read-back shows the old data */
+		sim->commits_rejected++;
+		sim_load_block(sim);
+		return;
+	}
+
+	if (sim->commit_delay_us)
+		usleep_range(sim->commit_delay_us, sim->commit_delay_us + 100);
+
+	memcpy(sim->dm[sim->dm_class][sim->dm_block], sim->block,
+	       sizeof(sim->block));
+	sim->commits++;
+}
+
+static void sim_write_byte(struct bq27441_sim *sim, u8 reg, u8 val)
+{
+	if (reg == SIM_DATA_CLASS) {
+		sim->dm_class = val;
+		sim->dm_block = 0;
+		sim_load_block(sim);
+	} else if (reg == SIM_DATA_BLOCK) {
+		sim->dm_block = val;
+		sim_load_block(sim);
+	} else if (reg >= SIM_BLOCK_DATA && reg < SIM_BLOCK_CHECKSUM) {
+		sim->block[reg - SIM_BLOCK_DATA] = val;
+	} else if (reg == SIM_BLOCK_CHECKSUM) {
+		sim_commit(sim, val);
+	}
+	/* Everything else is read only or accepted and ignored */
+}
+
+static bool sim_chance(u32 permille)
+{
+	return permille && prandom_u32_max(1000) < permille;
+}
+
+/*
+ * Called with sim->lock held: like a real adapter, the simulated bus
+ * carries one transaction at a time, so a stretched one stalls the rest.
+ */
+static void sim_bus_delay(struct bq27441_sim *sim, u32 base_us)
+{
+	u32 us = base_us;
+
+	if (sim->jitter_us)
+		us += prandom_u32_max(sim->jitter_us + 1);
+	if (sim_chance(sim->stretch_permille)) {
+		us += sim->stretch_us;
+		sim->injected_stretch++;
+	}
+
+	if (us)
+		usleep_range(us, us + 10);
+}
+
+/* Returns true if the gauge does not acknowledge this transaction */
+static bool sim_bus_nack(struct bq27441_sim *sim)
+{
+	if (sim_chance(sim->nack_permille)) {
+		sim->injected_nacks++;
+		return true;
+	}
+
+	return false;
+}
+
+static bool sim_busy(struct bq27441_sim *sim)
+{
+	if (!ktime_before(ktime_get(), sim->busy_until))
+		return false;
+
+	sim->injected_busy++;
+	return true;
+}
+
+static void sim_bench_account(struct bq27441_sim *sim, size_t bytes,
+			      int ret, ktime_t start)
+{
+	if (READ_ONCE(sim->bench_task) != current)
+		return;
+
+	sim->bench_tx++;
+	sim->bench_bytes += bytes;
+	if (ret < 0)
+		sim->bench_errors++;
+	sim->bench_bus_ns += ktime_to_ns(ktime_sub(ktime_get(), start));
+}
+
+/* Decode the record at @pos; returns the offset of the one after it */
+static size_t sim_replay_decode(struct bq27441_sim *sim, size_t pos,
+				struct bq27xxx_bus_record *rec,
+				const u8 **data)
+{
+	memcpy(rec, sim->replay_fw->data + pos, sizeof(*rec));
+	*data = sim->replay_fw->data + pos + sizeof(*rec);
+
+	return pos + sizeof(*rec) + rec->len;
+}
+
+/*
+ * Called with sim->lock held. Serves a transaction from the trace and
+ * returns true if the next record, or one of the SIM_REPLAY_LOOKAHEAD
+ * after it, is the same transaction; writes must carry the same data.
+ * A divergence is counted when the next record is not the one used.
+ */
+static bool sim_replay(struct bq27441_sim *sim, u8 reg, bool write,
+		       const u8 *buf, size_t len, int *ret)
+{
+	struct bq27xxx_bus_record rec;
+	size_t pos = sim->replay_pos, next;
+	const u8 *data;
+	int i;
+
+	if (pos >= sim->replay_end)
+		return false;
+
+	for (i = 0; i <= SIM_REPLAY_LOOKAHEAD && pos < sim->replay_end;
+	     i++, pos = next) {
+		next = sim_replay_decode(sim, pos, &rec, &data);
+		if (rec.reg == reg && rec.len == len &&
+		    !!(rec.flags & BQ27XXX_BUS_WRITE) == write &&
+		    (!write || !memcmp(data, buf, len)))
+			break;
+	}
+
+	if (i) {
+		if (!sim->replay_diverged++)
+			sim->replay_first_divergence = sim->replay_index;
+	}
+	if (i > SIM_REPLAY_LOOKAHEAD || pos >= sim->replay_end)
+		return false;
+
+	sim->replay_skipped += i;
+	sim->replay_matched++;
+	sim->replay_index += i + 1;
+	sim->replay_pos = next;
+
+	if (write || rec.result < 0)
+		*ret = rec.result;
+	else
+		*ret = len == 1 ? data[0] : get_unaligned_le16(data);
+
+	if (sim->replay_timing && rec.duration_ns) {
+		u32 us = DIV_ROUND_UP(rec.duration_ns, NSEC_PER_USEC);
+
+		usleep_range(us, us + 10);
+	}
+
+	return true;
+}
+
+/*
+ * Load the trace named by the replay parameter. Traces are in the byte
+ * order of the machine that recorded them; a foreign one fails the magic
+ * check. The chip class comes from the trace.
+ */
+static int sim_replay_load(struct bq27441_sim *sim, struct device *dev)
+{
+	struct bq27xxx_bus_trace_header hdr;
+	struct bq27xxx_bus_record rec;
+	const u8 *data;
+	size_t pos, next;
+	int ret;
+
+	ret = request_firmware(&sim->replay_fw, replay, dev);
+	if (ret) {
+		dev_err(dev, "failed to load bus trace %s: %d\n", replay, ret);
+		return ret;
+	}
+
+	if (sim->replay_fw->size < sizeof(hdr))
+		goto err_format;
+
+	memcpy(&hdr, sim->replay_fw->data, sizeof(hdr));
+	if (hdr.magic != BQ27XXX_BUS_TRACE_MAGIC ||
+	    hdr.version != BQ27XXX_BUS_TRACE_VERSION ||
+	    hdr.chip < BQ27000 || hdr.chip > BQ27421)
+		goto err_format;
+
+	/* Only whole records count; a read cut short leaves a torn tail */
+	sim->replay_end = sim->replay_fw->size;
+	for (pos = sizeof(hdr); pos + sizeof(rec) <= sim->replay_fw->size;
+	     pos = next) {
+		next = sim_replay_decode(sim, pos, &rec, &data);
+		if (next > sim->replay_fw->size)
+			break;
+		sim->replay_records++;
+	}
+	if (pos != sim->replay_fw->size)
+		dev_warn(dev, "ignoring %zu trailing bytes of %s\n",
+			 sim->replay_fw->size - pos, replay);
+
+	sim->replay_end = pos;
+	sim->replay_pos = sizeof(hdr);
+	sim->replay_first_divergence = -1;
+	sim->chip = hdr.chip;
+
+	dev_info(dev, "replaying %llu bus transactions from %s\n",
+		 sim->replay_records, replay);
+
+	return 0;
+
+err_format:
+	dev_err(dev, "%s is not a bus trace\n", replay);
+	release_firmware(sim->replay_fw);
+	sim->replay_fw = NULL;
+	return -EINVAL;
+}
+
+static int bq27441_sim_read(struct bq27xxx_device_info *di, u8 reg,
+			    bool single)
+{
+	struct bq27441_sim *sim = to_sim(di);
+	ktime_t start = ktime_get();
+	int ret;
+
+	mutex_lock(&sim->lock);
+	if (sim_replay(sim, reg, false, NULL, single ? 1 : 2, &ret)) {
+		/* Served from the trace */
+	} else {
+		sim_bus_delay(sim, sim->read_delay_us);
+		sim_settle(sim);
+		if (sim_bus_nack(sim)) {
+			ret = -EREMOTEIO;
+		} else if (sim_busy(sim)) {
+			ret = single ? 0xff : 0xffff;
+		} else {
+			ret = sim_read_byte(sim, reg);
+			if (!single)
+				ret |= sim_read_byte(sim, reg + 1) << 8;
+			/* High byte sampled before a carry from the low one */
+			if (!single && sim_chance(sim->torn_permille)) {
+				ret ^= 0x100;
+				sim->injected_torn++;
+			}
+		}
+	}
+	mutex_unlock(&sim->lock);
+
+	sim_bench_account(sim, single ? 2 : 3, ret, start);
+	bq27xxx_bus_account(di, reg, false, NULL, single ? 2 : 3, ret, 0,
+			    start);
+
+	return ret;
+}
+
+/*
+ * Returns the number of bytes sent, register address included, like I2C.
+ * Writes served from a trace still reach the model, so that it stays
+ * close to the recorded gauge once the trace runs out.
+ */
+static int bq27441_sim_write(struct bq27xxx_device_info *di, u8 reg,
+			     const u8 *data, size_t len)
+{
+	struct bq27441_sim *sim = to_sim(di);
+	ktime_t start = ktime_get();
+	int ret = len + 1;
+	size_t i;
+
+	mutex_lock(&sim->lock);
+	if (!sim_replay(sim, reg, true, data, len, &ret)) {
+		sim_bus_delay(sim, sim->write_delay_us);
+		sim_settle(sim);
+		if (sim_bus_nack(sim) || sim_busy(sim))
+			ret = -EREMOTEIO;
+	}
+	if (ret < 0) {
+		/* Not acknowledged, so the gauge never saw it */
+	} else if (reg == SIM_CONTROL && len >= 2)
+		sim_control(sim, data[0] | (data[1] << 8));
+	else
+		for (i = 0; i < len; i++)
+			sim_write_byte(sim, reg + i, data[i]);
+	mutex_unlock(&sim->lock);
+
+	sim_bench_account(sim, len + 1, ret, start);
+	bq27xxx_bus_account(di, reg, true, data, len + 1, ret, 0, start);
+
+	return ret;
+}
+
+static void sim_bench_props(struct bq27441_sim *sim)
+{
+	const struct power_supply_desc *desc = sim->di.bat->desc;
+	union power_supply_propval val;
+	size_t i;
+
+	for (i = 0; i < min_t(size_t, desc->num_properties, SIM_BENCH_NR_PROPS); i++)
+		power_supply_get_property(sim->di.bat, desc->properties[i], &val);
+}
+
+/* Check what actually landed in data memory, not what the driver read */
+static int sim_dm_verify(struct bq27441_sim *sim, u8 dataclass, u8 offset,
+			 const u8 *data, size_t len)
+{
+	const u8 *dm = sim->dm[dataclass][offset / SIM_BLOCK_SIZE];
+	int ret;
+
+	mutex_lock(&sim->lock);
+	ret = memcmp(&dm[offset % SIM_BLOCK_SIZE], data, len) ? -EIO : 0;
+	mutex_unlock(&sim->lock);
+
+	return ret;
+}
+
+static int sim_bench_exec(struct bq27441_sim *sim, enum sim_bench_op op)
+{
+	struct bq27xxx_device_info *di = &sim->di;
+	const u8 val = SIM_BENCH_DM_VALUE;
+	const u8 word[2] = { SIM_BENCH_DM_WORD_VALUE >> 8,
+			     SIM_BENCH_DM_WORD_VALUE & 0xff };
+	int ret = 0;
+
+	switch (op) {
+	case SIM_BENCH_UPDATE:
+		bq27xxx_lock(di, BQ27XXX_LOCK_UPDATE);
+		bq27xxx_battery_update(di);
+		bq27xxx_unlock(di);
+		break;
+	case SIM_BENCH_PROPS:
+	case SIM_BENCH_PROPS_STALE:
+		sim_bench_props(sim);
+		break;
+	case SIM_BENCH_CONFIG_ENTER:
+		ret = bq27441_config_mode(di, true);
+		break;
+	case SIM_BENCH_CONFIG_EXIT:
+		ret = bq27441_config_mode(di, false);
+		break;
+	case SIM_BENCH_DM_WRITE:
+		ret = bq27441_write_dm(di, SIM_BENCH_DM_CLASS,
+				       SIM_BENCH_DM_OFFSET, &val, true);
+		if (ret >= 0)
+			ret = sim_dm_verify(sim, SIM_BENCH_DM_CLASS,
+					    SIM_BENCH_DM_OFFSET, &val, 1);
+		break;
+	case SIM_BENCH_DM_WRITE_WORD:
+		ret = bq27441_write_dm(di, SIM_BENCH_DM_WORD_CLASS,
+				       SIM_BENCH_DM_WORD_OFFSET, word, false);
+		if (ret >= 0)
+			ret = sim_dm_verify(sim, SIM_BENCH_DM_WORD_CLASS,
+					    SIM_BENCH_DM_WORD_OFFSET, word, 2);
+		break;
+	case SIM_BENCH_CONFIGURE:
+		ret = bq27441_configure(di);
+		break;
+	default:
+		ret = -EINVAL;
+		break;
+	}
+
+	return ret;
+}
+
+/* Put the driver and the model in the state each operation starts from */
+static void sim_bench_prepare(struct bq27441_sim *sim, enum sim_bench_op op)
+{
+	struct bq27xxx_device_info *di = &sim->di;
+	unsigned int max_age_s = max(di->hibernate_poll_interval, 5U) + 1;
+
+	switch (op) {
+	case SIM_BENCH_UPDATE:
+	case SIM_BENCH_PROPS:
+		sim_bench_exec(sim, SIM_BENCH_UPDATE);
+		break;
+	case SIM_BENCH_PROPS_STALE:
+		write_seqlock(&di->cache_lock);
+		di->last_update = jiffies - max_age_s * HZ;
+		write_sequnlock(&di->cache_lock);
+		break;
+	case SIM_BENCH_CONFIG_EXIT:
+		bq27441_config_mode(di, true);
+		break;
+	default:
+		bq27441_config_mode(di, false);
+		break;
+	}
+}
+
+static bool sim_bench_run(struct bq27441_sim *sim, enum sim_bench_op op)
+{
+	struct sim_result *res = &sim->results[op];
+	unsigned long stamp;
+	ktime_t start;
+	u64 wall_ns;
+	u64 rejected;
+
+	/* Other chip classes read zeroes; their update counts mean nothing */
+	if (op == SIM_BENCH_UPDATE && sim->chip != BQ27421) {
+		res->valid = false;
+		return true;
+	}
+
+	sim_bench_prepare(sim, op);
+
+	sim->bench_tx = 0;
+	sim->bench_bytes = 0;
+	sim->bench_errors = 0;
+	sim->bench_bus_ns = 0;
+	WRITE_ONCE(sim->bench_task, current);
+	start = ktime_get();
+
+	stamp = sim->di.last_update;
+	rejected = sim->commits_rejected;
+	res->ret = sim_bench_exec(sim, op);
+	/* Every commit the driver issues must carry a valid checksum */
+	if (res->ret >= 0 && sim->commits_rejected != rejected)
+		res->ret = -EBADMSG;
+
+	wall_ns = ktime_to_ns(ktime_sub(ktime_get(), start));
+	WRITE_ONCE(sim->bench_task, NULL);
+
+	/*
+	 * A stale read is served from the snapshot and only kicks the
+	 * refresh; its bus traffic runs from the urgent work, not here.
+	 */
+	if (op == SIM_BENCH_PROPS_STALE) {
+		flush_work(&sim->di.urgent_work);
+		if (res->ret >= 0 && sim->di.last_update == stamp)
+			res->ret = -ENODATA;
+	}
+
+	/* Leave the gauge out of config mode for whatever runs next */
+	if (op >= SIM_BENCH_CONFIG_ENTER)
+		bq27441_config_mode(&sim->di, false);
+
+	res->budget = sim_budgets[op];
+
+	res->tx = sim->bench_tx;
+	res->bytes = sim->bench_bytes;
+	res->errors = sim->bench_errors;
+	res->bus_us = div_u64(sim->bench_bus_ns, NSEC_PER_USEC);
+	res->sleep_us = div_u64(wall_ns - min(wall_ns, sim->bench_bus_ns),
+				NSEC_PER_USEC);
+	res->pass = res->ret >= 0 && res->tx <= res->budget.tx &&
+		    res->bytes <= res->budget.bytes &&
+		    res->sleep_us <= res->budget.sleep_us + sim->bench_slack_us;
+	res->valid = true;
+
+	if (!res->pass)
+		dev_err(sim->di.dev,
+			"bench %s over budget: ret %d, %llu/%u transactions, %llu/%u bytes, %llu/%u us asleep\n",
+			sim_bench_names[op], res->ret, res->tx, res->budget.tx,
+			res->bytes, res->budget.bytes, res->sleep_us,
+			res->budget.sleep_us);
+
+	return res->pass;
+}
+
+static bool sim_bench_all(struct bq27441_sim *sim)
+{
+	bool pass = true;
+	int op;
+
+	for (op = 0; op < SIM_BENCH_OPS; op++)
+		pass &= sim_bench_run(sim, op);
+
+	return pass;
+}
+
+#ifdef CONFIG_DEBUG_FS
+static int sim_bench_show(struct seq_file *s, void *data)
+{
+	struct bq27441_sim *sim = s->private;
+	int op;
+
+	mutex_lock(&sim->bench_lock);
+	for (op = 0; op < SIM_BENCH_OPS; op++) {
+		struct sim_result *res = &sim->results[op];
+
+		if (!res->valid)
+			continue;
+		seq_printf(s, "%-13s %s tx %llu/%u bytes %llu/%u sleep_us %llu/%u bus_us %llu errors %llu ret %d\n",
+			   sim_bench_names[op], res->pass ? "PASS" : "FAIL",
+			   res->tx, res->budget.tx, res->bytes,
+			   res->budget.bytes, res->sleep_us,
+			   res->budget.sleep_us, res->bus_us, res->errors,
+			   res->ret);
+	}
+	mutex_unlock(&sim->bench_lock);
+
+	return 0;
+}
+
+static int sim_bench_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, sim_bench_show, inode->i_private);
+}
+
+/*
+ * Write an operation name, or "all"; fails with -ERANGE if over budget.
+ * "all" skips the update bench on chip classes the model does not map.
+ */
+static ssize_t sim_bench_write(struct file *file, const char __user *userbuf,
+			       size_t count, loff_t *ppos)
+{
+	struct seq_file *s = file->private_data;
+	struct bq27441_sim *sim = s->private;
+	char buf[16];
+	bool pass;
+	int op;
+
+	if (count >= sizeof(buf))
+		return -EINVAL;
+	if (copy_from_user(buf, userbuf, count))
+		return -EFAULT;
+	buf[count] = '\0';
+
+	if (sysfs_streq(buf, "all")) {
+		op = SIM_BENCH_OPS;
+	} else {
+		for (op = 0; op < SIM_BENCH_OPS; op++)
+			if (sysfs_streq(buf, sim_bench_names[op]))
+				break;
+		if (op == SIM_BENCH_OPS)
+			return -EINVAL;
+		if (op == SIM_BENCH_UPDATE && sim->chip != BQ27421)
+			return -EOPNOTSUPP;
+	}
+
+	mutex_lock(&sim->bench_lock);
+	if (op == SIM_BENCH_OPS)
+		pass = sim_bench_all(sim);
+	else
+		pass = sim_bench_run(sim, op);
+	mutex_unlock(&sim->bench_lock);
+
+	return pass ? count : -ERANGE;
+}
+
+static const struct file_operations sim_bench_fops = {
+	.owner = THIS_MODULE,
+	.open = sim_bench_open,
+	.read = seq_read,
+	.write = sim_bench_write,
+	.llseek = seq_lseek,
+	.release = single_release,
+};
+
+static int sim_replay_show(struct seq_file *s, void *data)
+{
+	struct bq27441_sim *sim = s->private;
+
+	mutex_lock(&sim->lock);
+	seq_printf(s, "records %llu\nconsumed %llu\nmatched %llu\n"
+		   "skipped %llu\ndiverged %llu\nfirst_divergence %lld\n",
+		   sim->replay_records, sim->replay_index,
+		   sim->replay_matched, sim->replay_skipped,
+		   sim->replay_diverged, sim->replay_first_divergence);
+	mutex_unlock(&sim->lock);
+
+	return 0;
+}
+
+static int sim_replay_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, sim_replay_show, inode->i_private);
+}
+
+/* Any write rewinds the trace and resets the counters */
+static ssize_t sim_replay_rewind(struct file *file, const char __user *userbuf,
+				 size_t count, loff_t *ppos)
+{
+	struct seq_file *s = file->private_data;
+	struct bq27441_sim *sim = s->private;
+
+	mutex_lock(&sim->lock);
+	sim->replay_pos = sizeof(struct bq27xxx_bus_trace_header);
+	sim->replay_index = 0;
+	sim->replay_matched = 0;
+	sim->replay_skipped = 0;
+	sim->replay_diverged = 0;
+	sim->replay_first_divergence = -1;
+	mutex_unlock(&sim->lock);
+
+	return count;
+}
+
+static const struct file_operations sim_replay_fops = {
+	.owner = THIS_MODULE,
+	.open = sim_replay_open,
+	.read = seq_read,
+	.write = sim_replay_rewind,
+	.llseek = seq_lseek,
+	.release = single_release,
+};
+
+static void bq27441_sim_create_debugfs(struct bq27441_sim *sim)
+{
+	struct dentry *dir = debugfs_create_dir("bq27441-sim", NULL);
+
+	sim->dfs_dir = dir;
+
+	debugfs_create_u32("read_delay_us", S_IRUGO | S_IWUSR, dir,
+			   &sim->read_delay_us);
+	debugfs_create_u32("write_delay_us", S_IRUGO | S_IWUSR, dir,
+			   &sim->write_delay_us);
+	debugfs_create_u32("commit_delay_us", S_IRUGO | S_IWUSR, dir,
+			   &sim->commit_delay_us);
+	debugfs_create_u32("cfg_delay_us", S_IRUGO | S_IWUSR, dir,
+			   &sim->cfg_delay_us);
+
+	debugfs_create_u16("temperature", S_IRUGO | S_IWUSR, dir,
+			   &sim->regs[SIM_TEMPERATURE / 2]);
+	debugfs_create_u16("voltage", S_IRUGO | S_IWUSR, dir,
+			   &sim->regs[SIM_VOLTAGE / 2]);
+	debugfs_create_u16("average_current", S_IRUGO | S_IWUSR, dir,
+			   &sim->regs[SIM_AVG_CURRENT / 2]);
+	debugfs_create_u16("state_of_charge", S_IRUGO | S_IWUSR, dir,
+			   &sim->regs[SIM_SOC / 2]);
+	debugfs_create_x16("flags", S_IRUGO | S_IWUSR, dir,
+			   &sim->regs[SIM_FLAGS / 2]);
+	debugfs_create_x16("control_status", S_IRUGO, dir,
+			   &sim->control_status);
+	debugfs_create_u64("commits", S_IRUGO, dir, &sim->commits);
+	debugfs_create_u64("commits_rejected", S_IRUGO, dir,
+			   &sim->commits_rejected);
+
+	debugfs_create_u32("jitter_us", S_IRUGO | S_IWUSR, dir,
+			   &sim->jitter_us);
+	debugfs_create_u32("stretch_us", S_IRUGO | S_IWUSR, dir,
+			   &sim->stretch_us);
+	debugfs_create_u32("stretch_permille", S_IRUGO | S_IWUSR, dir,
+			   &sim->stretch_permille);
+	debugfs_create_u32("nack_permille", S_IRUGO | S_IWUSR, dir,
+			   &sim->nack_permille);
+	debugfs_create_u32("torn_permille", S_IRUGO | S_IWUSR, dir,
+			   &sim->torn_permille);
+	debugfs_create_u32("reset_busy_us", S_IRUGO | S_IWUSR, dir,
+			   &sim->reset_busy_us);
+	debugfs_create_u64("injected_stretch", S_IRUGO, dir,
+			   &sim->injected_stretch);
+	debugfs_create_u64("injected_nacks", S_IRUGO, dir,
+			   &sim->injected_nacks);
+	debugfs_create_u64("injected_torn", S_IRUGO, dir,
+			   &sim->injected_torn);
+	debugfs_create_u64("injected_busy", S_IRUGO, dir,
+			   &sim->injected_busy);
+
+	debugfs_create_file("bench", S_IRUGO | S_IWUSR, dir, sim,
+			    &sim_bench_fops);
+	debugfs_create_u32("bench_slack_us", S_IRUGO | S_IWUSR, dir,
+			   &sim->bench_slack_us);
+
+	if (sim->replay_fw) {
+		debugfs_create_file("replay_status", S_IRUGO | S_IWUSR, dir,
+				    sim, &sim_replay_fops);
+		debugfs_create_bool("replay_timing", S_IRUGO | S_IWUSR, dir,
+				    &sim->replay_timing);
+	}
+}
+#else
+static inline void bq27441_sim_create_debugfs(struct bq27441_sim *sim) {}
+#endif /* CONFIG_DEBUG_FS */
+
+static int bq27441_sim_probe(struct platform_device *pdev)
+{
+	struct bq27441_sim *sim;
+	struct bq27xxx_device_info *di;
+	int ret;
+
+	if (chip < BQ27000 || chip > BQ27421) {
+		dev_err(&pdev->dev, "invalid chip class %u\n", chip);
+		return -EINVAL;
+	}
+
+	sim = devm_kzalloc(&pdev->dev, sizeof(*sim), GFP_KERNEL);
+	if (!sim)
+		return -ENOMEM;
+
+	mutex_init(&sim->lock);
+	mutex_init(&sim->bench_lock);
+	sim->bench_slack_us = SIM_BENCH_SLACK_US;
+	sim->chip = chip;
+
+	if (replay) {
+		ret = sim_replay_load(sim, &pdev->dev);
+		if (ret)
+			return ret;
+	}
+
+	sim_power_on(sim);
+
+	bq27441_sim_create_debugfs(sim);
+
+	platform_set_drvdata(pdev, sim);
+
+	di = &sim->di;
+	di->dev = &pdev->dev;
+	di->chip = sim->chip;
+	di->name = dev_name(&pdev->dev);
+	di->bus.read = bq27441_sim_read;
+	di->bus.write = bq27441_sim_write;
+
+	ret = bq27xxx_battery_setup(di);
+	if (ret) {
+		debugfs_remove_recursive(sim->dfs_dir);
+		release_firmware(sim->replay_fw);
+		return ret;
+	}
+
+	if (bench) {
+		mutex_lock(&sim->bench_lock);
+		if (sim_bench_all(sim))
+			dev_info(di->dev, "all benchmarks within budget\n");
+		mutex_unlock(&sim->bench_lock);
+	}
+
+	return 0;
+}
+
+static int bq27441_sim_remove(struct platform_device *pdev)
+{
+	struct bq27441_sim *sim = platform_get_drvdata(pdev);
+
+	bq27xxx_battery_teardown(&sim->di);
+
+	debugfs_remove_recursive(sim->dfs_dir);
+	release_firmware(sim->replay_fw);
+	mutex_destroy(&sim->bench_lock);
+	mutex_destroy(&sim->lock);
+
+	return 0;
+}
+
+#ifdef CONFIG_PM_SLEEP
+static int bq27441_sim_suspend(struct device *dev)
+{
+	struct bq27441_sim *sim = dev_get_drvdata(dev);
+
+	return bq27xxx_battery_suspend(&sim->di);
+}
+
+static int bq27441_sim_resume(struct device *dev)
+{
+	struct bq27441_sim *sim = dev_get_drvdata(dev);
+
+	return bq27xxx_battery_resume(&sim->di);
+}
+#endif /* CONFIG_PM_SLEEP */
+
+static SIMPLE_DEV_PM_OPS(bq27441_sim_pm_ops, bq27441_sim_suspend,
+			 bq27441_sim_resume);
+
+static struct platform_driver bq27441_sim_driver = {
+	.probe = bq27441_sim_probe,
+	.remove = bq27441_sim_remove,
+	.driver = {
+		.name = "bq27441-sim",
+		.pm = &bq27441_sim_pm_ops,
+	},
+};
+
+static int __init bq27441_sim_init(void)
+{
+	int ret;
+
+	ret = platform_driver_register(&bq27441_sim_driver);
+	if (ret)
+		return ret;
+
+	bq27441_sim_pdev = platform_device_register_simple("bq27441-sim", -1,
+							   NULL, 0);
+	if (IS_ERR(bq27441_sim_pdev)) {
+		platform_driver_unregister(&bq27441_sim_driver);
+		return PTR_ERR(bq27441_sim_pdev);
+	}
+
+	return 0;
+}
+module_init(bq27441_sim_init);
+
+static void __exit bq27441_sim_exit(void)
+{
+	platform_device_unregister(bq27441_sim_pdev);
+	platform_driver_unregister(&bq27441_sim_driver);
+}
+module_exit(bq27441_sim_exit);
+
+MODULE_DESCRIPTION("Simulated BQ27441 fuel gauge");
+MODULE_LICENSE("GPL");
@@ -0,0 +1,359 @@
+/*
+ * KUnit tests for the bq27441 data memory helpers
+ *
+ * Included at the end of bq27441_battery.c when built with
+ * BQ27441_KUNIT=y, so the static helpers can be tested as they are.
+ *
+ * The checksum helpers are checked against each other and against the
+ * golden configuration table. The block write and read paths run
+ * against a mock bus that keeps a few data memory blocks, commits a
+ * block only when its checksum matches, and counts the transactions
+ * each path issues.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+
+#include <kunit/test.h>
+
+#define TEST_DM_BLOCKS	3
+#define TEST_DM_CLASS	82
+
+struct test_gauge {
+	struct bq27xxx_device_info di;
+	struct device dev;
+	u8 dm[TEST_DM_BLOCKS][32];	/* committed data memory */
+	u8 buf[32];			/* block data transfer buffer */
+	u8 block;
+	unsigned int reads;
+	unsigned int writes;
+	unsigned int commits;
+	unsigned int rejected;
+};
+
+static struct test_gauge *to_test_gauge(struct bq27xxx_device_info *di)
+{
+	return container_of(di, struct test_gauge, di);
+}
+
+static int test_bus_read(struct bq27xxx_device_info *di, u8 reg,
+		bool single)
+{
+	struct test_gauge *g = to_test_gauge(di);
+	int ret;
+
+	g->reads++;
+
+	if (reg == BQ27441_BLOCK_DATA_CHECKSUM)
+		return dm_checksum(g->buf, sizeof(g->buf));
+
+	if (reg < 0x40 || reg + !single >= 0x40 + sizeof(g->buf))
+		return -EIO;
+
+	ret = g->buf[reg - 0x40];
+	if (!single)
+		ret |= g->buf[reg - 0x40 + 1] << 8;
+
+	return ret;
+}
+
+/* Returns the bytes sent including the register, as the i2c bus does */
+static int test_bus_write(struct bq27xxx_device_info *di, u8 reg,
+		const u8 *data, size_t len)
+{
+	struct test_gauge *g = to_test_gauge(di);
+
+	g->writes++;
+
+	if (reg == BQ27441_DATA_BLOCK_CLASS && len == 2) {
+		if (data[1] >= TEST_DM_BLOCKS)
+			return -EIO;
+		g->block = data[1];
+		memcpy(g->buf, g->dm[g->block], sizeof(g->buf));
+	} else if (reg == BQ27441_BLOCK_DATA_CHECKSUM && len == 1) {
+		if (data[0] == dm_checksum(g->buf, sizeof(g->buf))) {
+			memcpy(g->dm[g->block], g->buf, sizeof(g->buf));
+			g->commits++;
+		} else {
+			g->rejected++;
+		}
+	} else if (reg >= 0x40 && reg + len <= 0x40 + sizeof(g->buf)) {
+		memcpy(&g->buf[reg - 0x40], data, len);
+	} else {
+		return -EIO;
+	}
+
+	return len + 1;
+}
+
+static int test_gauge_init(struct kunit *test)
+{
+	struct test_gauge *g;
+	int i, j;
+
+	g = kunit_kzalloc(test, sizeof(*g), GFP_KERNEL);
+	KUNIT_ASSERT_NOT_ERR_OR_NULL(test, g);
+
+	g->dev.init_name = "bq27441-test";
+	g->di.dev = &g->dev;
+	g->di.chip = BQ27421;
+	g->di.name = "bq27441-test";
+	g->di.bus.read = test_bus_read;
+	g->di.bus.write = test_bus_write;
+
+	for (i = 0; i < TEST_DM_BLOCKS; i++)
+		for (j = 0; j < 32; j++)
+			g->dm[i][j] = i * 32 + j * 7;
+
+	test->priv = g;
+
+	return 0;
+}
+
+/* dm_checksum() */
+
+struct dm_checksum_case {
+	const char *name;
+	u8 data[32];
+	size_t len;
+	u8 checksum;
+};
+
+static const struct dm_checksum_case dm_checksum_cases[] = {
+	{ "empty", { }, 0, 0xff },
+	{ "zeroes", { }, 32, 0xff },
+	{ "one", { 0x01 }, 1, 0xfe },
+	{ "wraps", { 0xff, 0x01 }, 2, 0xff },
+	{ "design capacity", { 0x05, 0xdc }, 2, 0x1e },
+	{ "all ones", {
+		0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+		0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+		0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+		0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff }, 32, 0x1f },
+};
+
+static void dm_checksum_case_desc(const struct dm_checksum_case *c,
+		char *desc)
+{
+	strscpy(desc, c->name, KUNIT_PARAM_DESC_SIZE);
+}
+
+KUNIT_ARRAY_PARAM(dm_checksum, dm_checksum_cases, dm_checksum_case_desc);
+
+static void test_dm_checksum(struct kunit *test)
+{
+	const struct dm_checksum_case *c = test->param_value;
+
+	KUNIT_EXPECT_EQ(test, dm_checksum(c->data, c->len), c->checksum);
+}
+
+/* The golden table is checked at runtime too, but only at ITPOR */
+static void test_dm_checksum_golden(struct kunit *test)
+{
+	const struct bq27441_extended_cmd *cmd;
+	int i;
+
+	for (i = 0; i < ARRAY_SIZE(zerogravitas_golden_file); i++) {
+		cmd = &zerogravitas_golden_file[i];
+		KUNIT_EXPECT_EQ_MSG(test,
+				dm_checksum(cmd->command, sizeof(cmd->command)),
+				cmd->checksum, "entry %d, class %u block %u",
+				i, cmd->datablock[0], cmd->datablock[1]);
+	}
+}
+
+/* dm_checksum_update() */
+
+struct dm_update_case {
+	const char *name;
+	unsigned int offset;
+	size_t len;
+	u8 value[2];
+};
+
+static const struct dm_update_case dm_update_cases[] = {
+	{ "byte at 0", 0, 1, { 0x42 } },
+	{ "byte at 31", 31, 1, { 0xff } },
+	{ "byte unchanged", 5, 1, { 5 * 7 } },
+	{ "word at 0", 0, 2, { 0x0e, 0x10 } },
+	{ "word at 30", 30, 2, { 0x00, 0x00 } },
+	{ "word wrapping", 16, 2, { 0xff, 0xff } },
+};
+
+static void dm_update_case_desc(const struct dm_update_case *c, char *desc)
+{
+	strscpy(desc, c->name, KUNIT_PARAM_DESC_SIZE);
+}
+
+KUNIT_ARRAY_PARAM(dm_update, dm_update_cases, dm_update_case_desc);
+
+static void test_dm_checksum_update(struct kunit *test)
+{
+	const struct dm_update_case *c = test->param_value;
+	struct test_gauge *g = test->priv;
+	u8 *block = g->dm[0];
+	u8 old[2];
+	u8 checksum = dm_checksum(block, 32);
+
+	memcpy(old, &block[c->offset], c->len);
+	memcpy(&block[c->offset], c->value, c->len);
+
+	KUNIT_EXPECT_EQ(test, dm_checksum_update(checksum, old, c->value,
+				c->len), dm_checksum(block, 32));
+}
+
+/* Several fields of one block, each folded into the running checksum */
+static void test_dm_checksum_update_fields(struct kunit *test)
+{
+	struct test_gauge *g = test->priv;
+	u8 *block = g->dm[1];
+	u8 checksum = dm_checksum(block, 32);
+	u8 old[2];
+	int i;
+
+	for (i = 0; i < ARRAY_SIZE(dm_update_cases); i++) {
+		const struct dm_update_case *c = &dm_update_cases[i];
+
+		memcpy(old, &block[c->offset], c->len);
+		memcpy(&block[c->offset], c->value, c->len);
+		checksum = dm_checksum_update(checksum, old, c->value, c->len);
+	}
+
+	KUNIT_EXPECT_EQ(test, checksum, dm_checksum(block, 32));
+}
+
+/* write_extended_byteorword() and read_extended_byteorword() */
+
+struct dm_write_case {
+	const char *name;
+	u8 offset;
+	bool single;
+	u8 value[2];
+	int ret;
+	unsigned int writes;
+	unsigned int reads;
+};
+
+/*
+ * A write selects the block, reads the checksum and the old value,
+ * writes the new value and checksum, then selects the block again and
+ * reads the checksum back: four writes and three reads.
+ */
+static const struct dm_write_case dm_write_cases[] = {
+	{ "byte at 0", 0, true, { 0x42 }, 0, 4, 3 },
+	{ "word at 16", 16, false, { 0x0e, 0x10 }, 0, 4, 3 },
+	{ "byte at 31", 31, true, { 0x99 }, 0, 4, 3 },
+	{ "word at 31", 31, false, { 0x12, 0x34 }, -EINVAL, 0, 0 },
+	{ "byte at 32", 32, true, { 0x24 }, 0, 4, 3 },
+	{ "word at 32", 32, false, { 0xab, 0xcd }, 0, 4, 3 },
+	{ "word at 33", 33, false, { 0x01, 0x02 }, 0, 4, 3 },
+	{ "word at 94", 94, false, { 0x55, 0xaa }, 0, 4, 3 },
+};
+
+static void dm_write_case_desc(const struct dm_write_case *c, char *desc)
+{
+	strscpy(desc, c->name, KUNIT_PARAM_DESC_SIZE);
+}
+
+KUNIT_ARRAY_PARAM(dm_write, dm_write_cases, dm_write_case_desc);
+
+static void test_dm_write(struct kunit *test)
+{
+	const struct dm_write_case *c = test->param_value;
+	struct test_gauge *g = test->priv;
+	size_t len = c->single ? 1 : 2;
+	u8 expect[32];
+	int ret;
+
+	memcpy(expect, g->dm[c->offset / 32], sizeof(expect));
+	if (!c->ret)
+		memcpy(&expect[c->offset % 32], c->value, len);
+
+	ret = write_extended_byteorword(&g->di, TEST_DM_CLASS, c->offset,
+			c->value, c->single);
+
+	KUNIT_EXPECT_EQ(test, ret, c->ret);
+	KUNIT_EXPECT_EQ(test, g->writes, c->writes);
+	KUNIT_EXPECT_EQ(test, g->reads, c->reads);
+	KUNIT_EXPECT_EQ(test, g->commits, c->ret ? 0U : 1U);
+	KUNIT_EXPECT_EQ(test, g->rejected, 0U);
+	KUNIT_EXPECT_EQ(test, memcmp(g->dm[c->offset / 32], expect,
+				sizeof(expect)), 0);
+}
+
+/* A read selects the block and reads the value: one write, one read */
+static void test_dm_read(struct kunit *test)
+{
+	struct test_gauge *g = test->priv;
+	int ret;
+
+	ret = read_extended_byteorword(&g->di, TEST_DM_CLASS, 33, false);
+
+	/* Data memory words are big endian */
+	KUNIT_EXPECT_EQ(test, ret, g->dm[1][1] << 8 | g->dm[1][2]);
+	KUNIT_EXPECT_EQ(test, g->writes, 1U);
+	KUNIT_EXPECT_EQ(test, g->reads, 1U);
+}
+
+/*
+ * A table entry selects its block, writes the data and the checksum,
+ * selects the block again and reads the checksum back: four writes and
+ * one read.
+ */
+static void test_dm_write_cmd(struct kunit *test)
+{
+	struct test_gauge *g = test->priv;
+	struct bq27441_extended_cmd cmd = {
+		.datablock = { TEST_DM_CLASS, 2 },
+		.wait_time = 1,
+	};
+	int i;
+
+	for (i = 0; i < sizeof(cmd.command); i++)
+		cmd.command[i] = i;
+	cmd.checksum = dm_checksum(cmd.command, sizeof(cmd.command));
+
+	KUNIT_EXPECT_EQ(test, write_extended_cmd(&g->di, &cmd), 0);
+	KUNIT_EXPECT_EQ(test, g->writes, 4U);
+	KUNIT_EXPECT_EQ(test, g->reads, 1U);
+	KUNIT_EXPECT_EQ(test, g->commits, 1U);
+	KUNIT_EXPECT_EQ(test, memcmp(g->dm[2], cmd.command,
+				sizeof(cmd.command)), 0);
+}
+
+/* A bad table entry is caught before it touches the bus */
+static void test_dm_write_cmd_bad_checksum(struct kunit *test)
+{
+	struct test_gauge *g = test->priv;
+	struct bq27441_extended_cmd cmd = {
+		.datablock = { TEST_DM_CLASS, 0 },
+		.command = { 0x01 },
+		.checksum = 0xff,
+		.wait_time = 1,
+	};
+
+	KUNIT_EXPECT_EQ(test, write_extended_cmd(&g->di, &cmd), -EINVAL);
+	KUNIT_EXPECT_EQ(test, g->writes, 0U);
+	KUNIT_EXPECT_EQ(test, g->reads, 0U);
+}
+
+static struct kunit_case bq27441_test_cases[] = {
+	KUNIT_CASE_PARAM(test_dm_checksum, dm_checksum_gen_params),
+	KUNIT_CASE(test_dm_checksum_golden),
+	KUNIT_CASE_PARAM(test_dm_checksum_update, dm_update_gen_params),
+	KUNIT_CASE(test_dm_checksum_update_fields),
+	KUNIT_CASE_PARAM(test_dm_write, dm_write_gen_params),
+	KUNIT_CASE(test_dm_read),
+	KUNIT_CASE(test_dm_write_cmd),
+	KUNIT_CASE(test_dm_write_cmd_bad_checksum),
+	{}
+};
+
+static struct kunit_suite bq27441_test_suite = {
+	.name = "bq27441",
+	.init = test_gauge_init,
+	.test_cases = bq27441_test_cases,
+};
+
+kunit_test_suite(bq27441_test_suite);
@@ -0,0 +1,102 @@
+#undef TRACE_SYSTEM
+#define TRACE_SYSTEM bq27441
+
+#if !defined(_BQ27441_TRACE_H) || defined(TRACE_HEADER_MULTI_READ)
+#define _BQ27441_TRACE_H
+
+#include <linux/device.h>
+#include <linux/tracepoint.h>
+
+DECLARE_EVENT_CLASS(bq27441_config_mode,
+
+	TP_PROTO(struct device *dev, int ret),
+
+	TP_ARGS(dev, ret),
+
+	TP_STRUCT__entry(
+		__string(dev, dev_name(dev))
+		__field(int, ret)
+	),
+
+	TP_fast_assign(
+		__assign_str(dev, dev_name(dev));
+		__entry->ret = ret;
+	),
+
+	TP_printk("%s ret=%d", __get_str(dev), __entry->ret)
+);
+
+DEFINE_EVENT(bq27441_config_mode, bq27441_config_mode_enter,
+	TP_PROTO(struct device *dev, int ret),
+	TP_ARGS(dev, ret)
+);
+
+DEFINE_EVENT(bq27441_config_mode, bq27441_config_mode_exit,
+	TP_PROTO(struct device *dev, int ret),
+	TP_ARGS(dev, ret)
+);
+
+TRACE_EVENT(bq27441_block_commit,
+
+	TP_PROTO(struct device *dev, u8 dataclass, u8 block, u8 checksum,
+		 int ret),
+
+	TP_ARGS(dev, dataclass, block, checksum, ret),
+
+	TP_STRUCT__entry(
+		__string(dev, dev_name(dev))
+		__field(u8, dataclass)
+		__field(u8, block)
+		__field(u8, checksum)
+		__field(int, ret)
+	),
+
+	TP_fast_assign(
+		__assign_str(dev, dev_name(dev));
+		__entry->dataclass = dataclass;
+		__entry->block = block;
+		__entry->checksum = checksum;
+		__entry->ret = ret;
+	),
+
+	TP_printk("%s class=%u block=%u checksum=0x%02x ret=%d",
+		  __get_str(dev), __entry->dataclass, __entry->block,
+		  __entry->checksum, __entry->ret)
+);
+
+TRACE_EVENT(bq27441_checksum_verify,
+
+	TP_PROTO(struct device *dev, u8 dataclass, u8 block, u8 expected,
+		 u8 actual),
+
+	TP_ARGS(dev, dataclass, block, expected, actual),
+
+	TP_STRUCT__entry(
+		__string(dev, dev_name(dev))
+		__field(u8, dataclass)
+		__field(u8, block)
+		__field(u8, expected)
+		__field(u8, actual)
+	),
+
+	TP_fast_assign(
+		__assign_str(dev, dev_name(dev));
+		__entry->dataclass = dataclass;
+		__entry->block = block;
+		__entry->expected = expected;
+		__entry->actual = actual;
+	),
+
+	TP_printk("%s class=%u block=%u expected=0x%02x actual=0x%02x %s",
+		  __get_str(dev), __entry->dataclass, __entry->block,
+		  __entry->expected, __entry->actual,
+		  __entry->expected == __entry->actual ? "ok" : "MISMATCH")
+);
+
+#endif /* _BQ27441_TRACE_H */
+
+#undef TRACE_INCLUDE_PATH
+#define TRACE_INCLUDE_PATH .
+#undef TRACE_INCLUDE_FILE
+#define TRACE_INCLUDE_FILE bq27441_trace
+#include <trace/define_trace.h>
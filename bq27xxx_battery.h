@@ -29,9 +29,17 @@ struct bq27xxx_platform_data {
 };
 
 struct bq27xxx_device_info;
+
+/*
+ * @get and @put are optional. They keep the bus path powered across a
+ * burst of transactions; every @get is balanced by a @put, even when it
+ * fails.
+ */
 struct bq27xxx_access_methods {
 	int (*read)(struct bq27xxx_device_info *di, u8 reg, bool single);
 	int (*write)(struct bq27xxx_device_info *di, u8 reg, const u8 *data, size_t len);
+	int (*get)(struct bq27xxx_device_info *di);
+	void (*put)(struct bq27xxx_device_info *di);
 };
 
 struct bq27xxx_reg_cache {
@@ -46,28 +54,325 @@ struct bq27xxx_reg_cache {
 	int flags;
 	int power_avg;
 	int health;
+	int avg_current; /* raw Average Current register */
+	int voltage;
+	int charge_now;
+};
+
+enum bq27xxx_power_mode {
+	BQ27XXX_PM_NORMAL = 0,
+	BQ27XXX_PM_HIBERNATE,
+	BQ27XXX_PM_MODES,
+};
+
+/*
+ * Probe phases, in the order they run. bq27441_init() covers the
+ * FW_VERSION to CONFIGURE phases.
+ */
+enum bq27xxx_probe_phase {
+	BQ27XXX_PROBE_ALLOC = 0,
+	BQ27XXX_PROBE_PSY_REGISTER,
+	BQ27XXX_PROBE_INTERFACES,
+	BQ27XXX_PROBE_VOLTAGE,
+	BQ27XXX_PROBE_FW_VERSION,
+	BQ27XXX_PROBE_FLAGS,
+	BQ27XXX_PROBE_DM_CODE,
+	BQ27XXX_PROBE_CONFIGURE,
+	BQ27XXX_PROBE_FIRST_UPDATE,
+	BQ27XXX_PROBE_PHASES,
+};
+
+struct bq27xxx_probe_timing {
+	ktime_t start;
+	ktime_t mark;
+	s64 mark_bus_ns;
+	int mark_bus_ops;
+	s64 us[BQ27XXX_PROBE_PHASES];
+	s64 bus_ns[BQ27XXX_PROBE_PHASES];
+	int bus_ops[BQ27XXX_PROBE_PHASES];
+};
+
+/* Call sites of di->lock, accounted separately in the lock_stats file */
+enum bq27xxx_lock_site {
+	BQ27XXX_LOCK_UPDATE = 0,	/* poll work and resume resync */
+	BQ27XXX_LOCK_PROPERTY,		/* stale property reads, skips only */
+	BQ27XXX_LOCK_DEBUGFS,		/* debugfs reads */
+	BQ27XXX_LOCK_CONFIG,		/* config sessions and data flash writes */
+	BQ27XXX_LOCK_IRQ,		/* FLAGS read in the IRQ handler */
+	BQ27XXX_LOCK_SAMPLE,		/* capture and IIO samples */
+	BQ27XXX_LOCK_OTHER,
+	BQ27XXX_LOCK_SITES,
+};
+
+struct bq27xxx_lock_stats {
+	u64 acquired;
+	u64 contended;
+	u64 skipped;	/* gave up instead of waiting */
+	u64 wait_total_ns;
+	u64 wait_max_ns;
+	u64 hold_total_ns;
+	u64 hold_max_ns;
 };
 
 struct dentry;
+struct page;
+
+/* Gauges sharing one bus adapter, polled in turn */
+struct bq27xxx_bus_group {
+	struct list_head node;
+	struct list_head devices;
+	const void *key;
+	char name[32];
+	unsigned int nr_devices;
+	struct semaphore sem;
+	ktime_t epoch;
+	atomic64_t reads;
+	atomic64_t batched;
+	atomic64_t busy_ns;
+	atomic64_t wait_ns;
+	struct dentry *dfs_file;
+};
+
+struct bq27xxx_events;
+struct bq27xxx_capture;
+struct iio_dev;
+struct bq27xxx_bus_stats;
+struct bq27xxx_bus_trace;
 
 struct bq27xxx_device_info {
 	struct device *dev;
 	enum bq27xxx_chip chip;
 	const char *name;
 	struct bq27xxx_access_methods bus;
+	seqlock_t cache_lock;
 	struct bq27xxx_reg_cache cache;
+	u64 cache_seq;
+	ktime_t cache_time;
+	struct page *snap_page;
 	int charge_design_full;
 	unsigned long last_update;
 	struct delayed_work work;
+	struct work_struct urgent_work;
+	struct delayed_work notify_work;
+	struct bq27xxx_reg_cache notified;
+	ktime_t notify_time;
+	unsigned int notify_voltage_mv;
+	unsigned int notify_temp_dc;
+	unsigned int notify_interval_ms;
+	struct bq27xxx_events *events;
+	struct bq27xxx_capture *capture;
+	struct iio_dev *iio;
+	struct bq27xxx_bus_stats *bus_stats;
+	struct bq27xxx_bus_trace *bus_trace;
+	atomic64_t bus_ns;
+	atomic_t bus_ops;
+	struct bq27xxx_probe_timing probe;
+	struct dentry *dfs_dev_dir;
+	unsigned int poll_interval;
+	spinlock_t work_lock; /* Arming the works vs. removed/suspended */
+	unsigned long next_poll;
+	bool removed;
+	bool suspended;
+	ktime_t suspend_time;
+	unsigned int suspend_poll_ms;
+	s64 last_suspend_ms;
+	s64 resume_latency_us;
+	s64 resume_latency_max_us;
+	spinlock_t rpm_lock;
+	bool rpm_active;
+	ktime_t rpm_since;
+	ktime_t rpm_epoch;
+	s64 rpm_active_us;
+	unsigned int rpm_resumes;
+	const void *bus_key;
+	const char *bus_name;
+	struct bq27xxx_bus_group *group;
+	struct list_head group_node;
+	unsigned int poll_slot;
 	struct power_supply *bat;
 	struct mutex lock;
+	enum bq27xxx_lock_site lock_site;
+	ktime_t lock_since;
+	spinlock_t lock_stats_lock;
+	struct bq27xxx_lock_stats lock_stats[BQ27XXX_LOCK_SITES];
+	wait_queue_head_t refresh_wait;
+	atomic_t refresh_pending;
+	atomic_t maint_active;
+	ktime_t maint_start;
+	s64 maint_last_us;
+	s64 maint_max_us;
+	unsigned int maint_count;
+	spinlock_t irq_lock;
+	bool irq_pending;
+	ktime_t irq_time;
+	unsigned int irq_count;
+	s64 irq_latency_last_us;
+	s64 irq_latency_max_us;
 	u8 *regs;
+	enum bq27xxx_power_mode pm_mode;
+	ktime_t pm_mode_since;
+	s64 pm_mode_ms[BQ27XXX_PM_MODES];
+	unsigned int pm_transitions;
+	bool pm_low;
+	ktime_t pm_low_since;
+	atomic_t pm_wake;
+	unsigned int hibernate_threshold_ua;
+	unsigned int hibernate_poll_interval;
 	struct dentry *dfs_dir;
 	struct dentry *dfs_polarity_file;
 };
 
+static inline int bq27xxx_pm_get(struct bq27xxx_device_info *di)
+{
+	return di->bus.get ? di->bus.get(di) : 0;
+}
+
+static inline void bq27xxx_pm_put(struct bq27xxx_device_info *di)
+{
+	if (di->bus.put)
+		di->bus.put(di);
+}
+
+/*
+ * Charge the time and bus traffic since the previous mark to @phase. Only
+ * the probe path marks phases, but from PSY_REGISTER on the interfaces
+ * are live: bus time spent on property reads, sysfs, IIO or capture
+ * while probe runs is charged to the phase in progress.
+ */
+static inline void bq27xxx_probe_mark(struct bq27xxx_device_info *di,
+				      enum bq27xxx_probe_phase phase)
+{
+	struct bq27xxx_probe_timing *t = &di->probe;
+	ktime_t now = ktime_get();
+	s64 bus_ns = atomic64_read(&di->bus_ns);
+	int bus_ops = atomic_read(&di->bus_ops);
+
+	t->us[phase] += ktime_us_delta(now, t->mark);
+	t->bus_ns[phase] += bus_ns - t->mark_bus_ns;
+	t->bus_ops[phase] += bus_ops - t->mark_bus_ops;
+	t->mark = now;
+	t->mark_bus_ns = bus_ns;
+	t->mark_bus_ops = bus_ops;
+}
+
+/*
+ * Wrappers around di->lock that account wait and hold times per call
+ * site. They are inline so that bq27441 can use them without linking
+ * against the core.
+ */
+static inline void bq27xxx_lock_acquired(struct bq27xxx_device_info *di,
+					 enum bq27xxx_lock_site site,
+					 bool contended, ktime_t start)
+{
+	struct bq27xxx_lock_stats *st = &di->lock_stats[site];
+	u64 wait_ns;
+
+	di->lock_since = ktime_get();
+	di->lock_site = site;
+	wait_ns = ktime_to_ns(ktime_sub(di->lock_since, start));
+
+	spin_lock(&di->lock_stats_lock);
+	st->acquired++;
+	if (contended) {
+		st->contended++;
+		st->wait_total_ns += wait_ns;
+		if (wait_ns > st->wait_max_ns)
+			st->wait_max_ns = wait_ns;
+	}
+	spin_unlock(&di->lock_stats_lock);
+}
+
+static inline void bq27xxx_lock(struct bq27xxx_device_info *di,
+				enum bq27xxx_lock_site site)
+{
+	ktime_t start = ktime_get();
+	bool contended = !mutex_trylock(&di->lock);
+
+	if (contended)
+		mutex_lock(&di->lock);
+	bq27xxx_lock_acquired(di, site, contended, start);
+}
+
+static inline bool bq27xxx_trylock(struct bq27xxx_device_info *di,
+				   enum bq27xxx_lock_site site)
+{
+	if (!mutex_trylock(&di->lock))
+		return false;
+	bq27xxx_lock_acquired(di, site, false, ktime_get());
+	return true;
+}
+
+/* Record that @site found the lock busy and did without it */
+static inline void bq27xxx_lock_skipped(struct bq27xxx_device_info *di,
+					enum bq27xxx_lock_site site)
+{
+	spin_lock(&di->lock_stats_lock);
+	di->lock_stats[site].contended++;
+	di->lock_stats[site].skipped++;
+	spin_unlock(&di->lock_stats_lock);
+}
+
+static inline void bq27xxx_unlock(struct bq27xxx_device_info *di)
+{
+	struct bq27xxx_lock_stats *st = &di->lock_stats[di->lock_site];
+	u64 hold_ns = ktime_to_ns(ktime_sub(ktime_get(), di->lock_since));
+
+	mutex_unlock(&di->lock);
+
+	spin_lock(&di->lock_stats_lock);
+	st->hold_total_ns += hold_ns;
+	if (hold_ns > st->hold_max_ns)
+		st->hold_max_ns = hold_ns;
+	spin_unlock(&di->lock_stats_lock);
+}
+
+/*
+ * Claim the bus for one burst of transactions. Returns the group that has
+ * to be passed to bq27xxx_bus_release(), or NULL if the gauge is not
+ * grouped. Take di->lock first. Inline for the same reason as above.
+ */
+static inline struct bq27xxx_bus_group *
+bq27xxx_bus_claim(struct bq27xxx_device_info *di, ktime_t *start)
+{
+	struct bq27xxx_bus_group *group = READ_ONCE(di->group);
+	ktime_t wait_start;
+
+	if (!group)
+		return NULL;
+
+	wait_start = ktime_get();
+	down(&group->sem);
+	*start = ktime_get();
+	atomic64_add(ktime_to_ns(ktime_sub(*start, wait_start)),
+		     &group->wait_ns);
+
+	return group;
+}
+
+static inline void bq27xxx_bus_release(struct bq27xxx_bus_group *group,
+				       ktime_t start)
+{
+	if (!group)
+		return;
+
+	atomic64_add(ktime_to_ns(ktime_sub(ktime_get(), start)),
+		     &group->busy_ns);
+	atomic64_inc(&group->reads);
+	up(&group->sem);
+}
+
 void bq27xxx_battery_update(struct bq27xxx_device_info *di);
+void bq27xxx_battery_irq(struct bq27xxx_device_info *di);
 int bq27xxx_battery_setup(struct bq27xxx_device_info *di);
+void bq27xxx_battery_start_polling(struct bq27xxx_device_info *di,
+				   unsigned int delay_s);
 void bq27xxx_battery_teardown(struct bq27xxx_device_info *di);
+int bq27xxx_battery_suspend(struct bq27xxx_device_info *di);
+int bq27xxx_battery_resume(struct bq27xxx_device_info *di);
+void bq27xxx_battery_runtime_suspend(struct bq27xxx_device_info *di);
+void bq27xxx_battery_runtime_resume(struct bq27xxx_device_info *di);
+void bq27xxx_bus_account(struct bq27xxx_device_info *di, u8 reg,
+			 bool write, const u8 *data, size_t bytes, int ret,
+			 unsigned int retries, ktime_t start);
 
 #endif
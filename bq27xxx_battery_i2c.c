@@ -17,6 +17,8 @@
 #include <linux/i2c.h>
 #include <linux/interrupt.h>
 #include <linux/module.h>
+#include <linux/ktime.h>
+#include <linux/pm_runtime.h>
 #include <asm/unaligned.h>
 #include <linux/slab.h>
 
@@ -24,21 +26,40 @@
 
 #include "bq27xxx_battery.h"
 
+/* Long enough to cover one snapshot burst */
+#define BQ27XXX_I2C_AUTOSUSPEND_MS	100
+
 static irqreturn_t bq27xxx_battery_irq_handler_thread(int irq, void *data)
 {
 	struct bq27xxx_device_info *di = data;
 
-	bq27xxx_battery_update(di);
+	bq27xxx_battery_irq(di);
 
 	return IRQ_HANDLED;
 }
 
+static int bq27xxx_battery_i2c_get(struct bq27xxx_device_info *di)
+{
+	int ret;
+
+	ret = pm_runtime_get_sync(di->dev);
+
+	return ret < 0 ? ret : 0;
+}
+
+static void bq27xxx_battery_i2c_put(struct bq27xxx_device_info *di)
+{
+	pm_runtime_mark_last_busy(di->dev);
+	pm_runtime_put_autosuspend(di->dev);
+}
+
 static int bq27xxx_battery_i2c_read(struct bq27xxx_device_info *di, u8 reg,
 				    bool single)
 {
 	struct i2c_client *client = to_i2c_client(di->dev);
 	struct i2c_msg msg[2];
 	unsigned char data[2];
+	ktime_t start;
 	int ret;
 
 	if (!client->adapter)
@@ -56,7 +77,16 @@ static int bq27xxx_battery_i2c_read(struct bq27xxx_device_info *di, u8 reg,
 	else
 		msg[1].len = 2;
 
-	ret = i2c_transfer(client->adapter, msg, ARRAY_SIZE(msg));
+	/* A failed resume is accounted, and traced, as a failed transfer */
+	start = ktime_get();
+	ret = bq27xxx_battery_i2c_get(di);
+	if (!ret) {
+		start = ktime_get();
+		ret = i2c_transfer(client->adapter, msg, ARRAY_SIZE(msg));
+	}
+	bq27xxx_bus_account(di, reg, false, data, sizeof(reg) + msg[1].len,
+			    ret, 0, start);
+	bq27xxx_battery_i2c_put(di);
 	if (ret < 0)
 		return ret;
 
@@ -74,6 +104,7 @@ static int bq27xxx_battery_i2c_write(struct bq27xxx_device_info *di, u8 reg,
 	struct i2c_client *client = to_i2c_client(di->dev);
 	int ret;
 	unsigned char *buf;
+	ktime_t start;
 
 	if (!client->adapter)
 		return -ENODEV;
@@ -85,7 +116,15 @@ static int bq27xxx_battery_i2c_write(struct bq27xxx_device_info *di, u8 reg,
 	buf[0] = reg;
 	memcpy (&buf[1], data, len);
 
-	ret = i2c_master_send(client, buf, len + sizeof(reg));
+	start = ktime_get();
+	ret = bq27xxx_battery_i2c_get(di);
+	if (!ret) {
+		start = ktime_get();
+		ret = i2c_master_send(client, buf, len + sizeof(reg));
+	}
+	bq27xxx_bus_account(di, reg, true, data, len + sizeof(reg), ret, 0,
+			    start);
+	bq27xxx_battery_i2c_put(di);
 
 	kfree(buf);
 
@@ -107,16 +146,26 @@ static int bq27xxx_battery_i2c_probe(struct i2c_client *client,
 	di->name = id->name;
 	di->bus.read = bq27xxx_battery_i2c_read;
 	di->bus.write = bq27xxx_battery_i2c_write;
+	di->bus.get = bq27xxx_battery_i2c_get;
+	di->bus.put = bq27xxx_battery_i2c_put;
+	di->bus_key = client->adapter;
+	di->bus_name = dev_name(&client->adapter->dev);
 
-	ret = bq27xxx_battery_setup(di);
-	if (ret)
-		return ret;
+	i2c_set_clientdata(client, di);
 
-	/* Schedule a polling after about 1 min */
-	schedule_delayed_work(&di->work, 60 * HZ);
+	/* Stay active until setup has finished its first burst */
+	pm_runtime_get_noresume(&client->dev);
+	pm_runtime_set_active(&client->dev);
+	pm_runtime_set_autosuspend_delay(&client->dev,
+					 BQ27XXX_I2C_AUTOSUSPEND_MS);
+	pm_runtime_use_autosuspend(&client->dev);
+	pm_runtime_enable(&client->dev);
 
-	i2c_set_clientdata(client, di);
+	ret = bq27xxx_battery_setup(di);
+	if (ret)
+		goto err_rpm;
 
+	/* Before polling starts, so nothing is armed if this fails */
 	if (client->irq) {
 		ret = devm_request_threaded_irq(&client->dev, client->irq,
 				NULL, bq27xxx_battery_irq_handler_thread,
@@ -126,22 +175,90 @@ static int bq27xxx_battery_i2c_probe(struct i2c_client *client,
 			dev_err(&client->dev,
 				"Unable to register IRQ %d error %d\n",
 				client->irq, ret);
-			return ret;
+			bq27xxx_battery_teardown(di);
+			goto err_rpm;
 		}
 	}
 
+	bq27xxx_battery_i2c_put(di);
+
+	/* Schedule a polling after about 1 min */
+	bq27xxx_battery_start_polling(di, 60);
+
 	return 0;
+
+err_rpm:
+	pm_runtime_disable(&client->dev);
+	pm_runtime_dont_use_autosuspend(&client->dev);
+	pm_runtime_set_suspended(&client->dev);
+	pm_runtime_put_noidle(&client->dev);
+	return ret;
 }
 
 static int bq27xxx_battery_i2c_remove(struct i2c_client *client)
 {
 	struct bq27xxx_device_info *di = i2c_get_clientdata(client);
 
+	/* The IRQ is devm managed; keep it from re-arming the work */
+	if (client->irq)
+		disable_irq(client->irq);
+
 	bq27xxx_battery_teardown(di);
 
+	pm_runtime_disable(&client->dev);
+	pm_runtime_dont_use_autosuspend(&client->dev);
+	pm_runtime_set_suspended(&client->dev);
+
 	return 0;
 }
 
+#ifdef CONFIG_PM_SLEEP
+static int bq27xxx_battery_i2c_suspend(struct device *dev)
+{
+	struct bq27xxx_device_info *di = dev_get_drvdata(dev);
+
+	return bq27xxx_battery_suspend(di);
+}
+
+static int bq27xxx_battery_i2c_resume(struct device *dev)
+{
+	struct bq27xxx_device_info *di = dev_get_drvdata(dev);
+
+	return bq27xxx_battery_resume(di);
+}
+#endif /* CONFIG_PM_SLEEP */
+
+#ifdef CONFIG_PM
+/*
+ * Nothing to power down on the gauge itself; going idle lets the adapter
+ * and its clocks suspend. Only account for the time spent active.
+ */
+static int bq27xxx_battery_i2c_runtime_suspend(struct device *dev)
+{
+	struct bq27xxx_device_info *di = dev_get_drvdata(dev);
+
+	bq27xxx_battery_runtime_suspend(di);
+
+	return 0;
+}
+
+static int bq27xxx_battery_i2c_runtime_resume(struct device *dev)
+{
+	struct bq27xxx_device_info *di = dev_get_drvdata(dev);
+
+	bq27xxx_battery_runtime_resume(di);
+
+	return 0;
+}
+#endif /* CONFIG_PM */
+
+static const struct dev_pm_ops bq27xxx_battery_i2c_pm_ops = {
+	SET_SYSTEM_SLEEP_PM_OPS(bq27xxx_battery_i2c_suspend,
+				bq27xxx_battery_i2c_resume)
+	SET_RUNTIME_PM_OPS(bq27xxx_battery_i2c_runtime_suspend,
+			   bq27xxx_battery_i2c_runtime_resume, NULL)
+};
+
 static const struct i2c_device_id bq27xxx_i2c_id_table[] = {
 	{ "bq27200", BQ27000 },
 	{ "bq27210", BQ27010 },
@@ -190,6 +307,7 @@ static struct i2c_driver bq27xxx_battery_i2c_driver = {
 	.driver = {
 		.name = "bq27xxx-battery",
 		.of_match_table = of_match_ptr(bq27xxx_battery_i2c_of_match_table),
+		.pm = &bq27xxx_battery_i2c_pm_ops,
 	},
 	.probe = bq27xxx_battery_i2c_probe,
 	.remove = bq27xxx_battery_i2c_remove,
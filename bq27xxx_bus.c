@@ -0,0 +1,799 @@
+/*
+ * BQ27xxx battery driver - bus scheduling, statistics and register trace
+ *
+ * This package is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * THIS PACKAGE IS PROVIDED ``AS IS'' AND WITHOUT ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, WITHOUT LIMITATION, THE IMPLIED
+ * WARRANTIES OF MERCHANTIBILITY AND FITNESS FOR A PARTICULAR PURPOSE.
+ */
+
+#include <linux/module.h>
+#include <linux/jiffies.h>
+#include <linux/workqueue.h>
+#include <linux/slab.h>
+#include <linux/list.h>
+#include <linux/mutex.h>
+#include <linux/semaphore.h>
+#include <linux/math64.h>
+#include <linux/debugfs.h>
+#include <linux/seq_file.h>
+#include <linux/kfifo.h>
+#include <linux/uaccess.h>
+#include <linux/power_supply.h>
+
+#include "bq27xxx_battery.h"
+#include "bq27xxx_internal.h"
+#include "bq27xxx_snapshot.h"
+#include "bq27xxx_trace.h"
+
+static unsigned int bus_max_readers = 1;
+module_param(bus_max_readers, uint, 0444);
+MODULE_PARM_DESC(bus_max_readers,
+		 "maximum concurrent snapshot reads per bus adapter");
+
+static unsigned int bus_batch_ms = 500;
+module_param(bus_batch_ms, uint, 0644);
+MODULE_PARM_DESC(bus_batch_ms,
+		 "pull polls due within this many ms forward to run back-to-back with a poll on the same bus - 0 disables batching");
+
+/*
+ * Per-bus scheduling
+ *
+ * Gauges behind the same adapter (identified by di->bus_key) share a
+ * bq27xxx_bus_group. Each member gets an evenly spaced slot in its poll
+ * interval, the number of concurrent snapshot reads on the bus is bounded
+ * by a semaphore, and polls that fall due close together are batched.
+ */
+
+static LIST_HEAD(bq27xxx_bus_groups);
+static DEFINE_MUTEX(bq27xxx_bus_lock);
+
+#ifdef CONFIG_DEBUG_FS
+static ssize_t bq27xxx_bus_stats_read(struct file *fp, char __user *userbuf,
+				      size_t count, loff_t *offset)
+{
+	struct bq27xxx_bus_group *group = fp->private_data;
+	char buf[256];
+	u64 elapsed_ns, busy_ns, wait_ns;
+	u64 permille = 0;
+	unsigned int nr;
+	int ret;
+
+	mutex_lock(&bq27xxx_bus_lock);
+	nr = group->nr_devices;
+	mutex_unlock(&bq27xxx_bus_lock);
+
+	elapsed_ns = ktime_to_ns(ktime_sub(ktime_get(), group->epoch));
+	busy_ns = atomic64_read(&group->busy_ns);
+	wait_ns = atomic64_read(&group->wait_ns);
+	if (elapsed_ns)
+		permille = div64_u64(busy_ns * 1000, elapsed_ns);
+
+	ret = scnprintf(buf, sizeof(buf),
+			"devices %u\n"
+			"max_readers %u\n"
+			"snapshot_reads %lld\n"
+			"batched_polls %lld\n"
+			"busy_ms %llu\n"
+			"wait_ms %llu\n"
+			"utilization_permille %llu\n",
+			nr, bus_max_readers,
+			atomic64_read(&group->reads),
+			atomic64_read(&group->batched),
+			div64_u64(busy_ns, NSEC_PER_MSEC),
+			div64_u64(wait_ns, NSEC_PER_MSEC),
+			permille);
+
+	return simple_read_from_buffer(userbuf, count, offset, buf, ret);
+}
+
+static const struct file_operations bq27xxx_bus_stats_fops = {
+	.owner = THIS_MODULE,
+	.open = simple_open,
+	.read = bq27xxx_bus_stats_read,
+};
+#endif /* CONFIG_DEBUG_FS */
+
+void bq27xxx_bus_join(struct bq27xxx_device_info *di)
+{
+	struct bq27xxx_bus_group *group;
+
+	if (!di->bus_key)
+		return;
+
+	mutex_lock(&bq27xxx_bus_lock);
+
+	list_for_each_entry(group, &bq27xxx_bus_groups, node)
+		if (group->key == di->bus_key)
+			goto found;
+
+	group = kzalloc(sizeof(*group), GFP_KERNEL);
+	if (!group) {
+		/* Not fatal; this gauge just polls on its own */
+		mutex_unlock(&bq27xxx_bus_lock);
+		return;
+	}
+
+	INIT_LIST_HEAD(&group->devices);
+	group->key = di->bus_key;
+	strlcpy(group->name, di->bus_name ?: "bus", sizeof(group->name));
+	sema_init(&group->sem, max(bus_max_readers, 1U));
+	group->epoch = ktime_get();
+	atomic64_set(&group->reads, 0);
+	atomic64_set(&group->batched, 0);
+	atomic64_set(&group->busy_ns, 0);
+	atomic64_set(&group->wait_ns, 0);
+#ifdef CONFIG_DEBUG_FS
+	group->dfs_file = debugfs_create_file(group->name, S_IRUGO,
+					      bq27xxx_dfs_buses, group,
+					      &bq27xxx_bus_stats_fops);
+#endif /* CONFIG_DEBUG_FS */
+	list_add_tail(&group->node, &bq27xxx_bus_groups);
+
+found:
+	di->poll_slot = group->nr_devices++;
+	list_add_tail(&di->group_node, &group->devices);
+	di->group = group;
+
+	mutex_unlock(&bq27xxx_bus_lock);
+}
+
+void bq27xxx_bus_leave(struct bq27xxx_device_info *di)
+{
+	struct bq27xxx_bus_group *group = di->group;
+	struct bq27xxx_device_info *other;
+	unsigned int slot = 0;
+
+	if (!group)
+		return;
+
+	mutex_lock(&bq27xxx_bus_lock);
+
+	list_del(&di->group_node);
+	di->group = NULL;
+
+	/* Close the gap so the remaining gauges stay evenly spread */
+	list_for_each_entry(other, &group->devices, group_node)
+		other->poll_slot = slot++;
+	group->nr_devices = slot;
+
+	if (!group->nr_devices) {
+		list_del(&group->node);
+		debugfs_remove_recursive(group->dfs_file);
+		kfree(group);
+	}
+
+	mutex_unlock(&bq27xxx_bus_lock);
+}
+
+/*
+ * Pull the polls of other gauges on the same bus that are due within
+ * bus_batch_ms forward, so the adapter serves them back-to-back.
+ */
+void bq27xxx_bus_batch(struct bq27xxx_device_info *di)
+{
+	struct bq27xxx_bus_group *group = READ_ONCE(di->group);
+	struct bq27xxx_device_info *other;
+	unsigned int window_ms = READ_ONCE(bus_batch_ms);
+	unsigned long horizon;
+
+	if (!group || !window_ms)
+		return;
+
+	horizon = jiffies + msecs_to_jiffies(window_ms);
+
+	mutex_lock(&bq27xxx_bus_lock);
+	list_for_each_entry(other, &group->devices, group_node) {
+		if (other == di || !delayed_work_pending(&other->work) ||
+		    !time_before(other->next_poll, horizon))
+			continue;
+
+		spin_lock(&other->work_lock);
+		if (!other->removed && !other->suspended) {
+			mod_delayed_work(bq27xxx_wq, &other->work, 0);
+			atomic64_inc(&group->batched);
+		}
+		spin_unlock(&other->work_lock);
+	}
+	mutex_unlock(&bq27xxx_bus_lock);
+}
+
+/*
+ * Delay in jiffies until this gauge's next slot that is at least
+ * @min_ns away. Slots are spaced evenly across the poll interval by
+ * position in the bus group.
+ */
+unsigned long bq27xxx_bus_slot_delay(struct bq27xxx_device_info *di,
+				     unsigned int interval, u64 min_ns)
+{
+	struct bq27xxx_bus_group *group = READ_ONCE(di->group);
+	u64 period = (u64)interval * NSEC_PER_SEC;
+	u64 phase, since_slot, delay;
+	unsigned int nr;
+
+	nr = group ? READ_ONCE(group->nr_devices) : 0;
+	if (nr < 2)
+		return 0;
+
+	phase = div64_u64(period * min(READ_ONCE(di->poll_slot), nr - 1), nr);
+	div64_u64_rem(ktime_to_ns(ktime_sub(ktime_get(), group->epoch)) +
+		      period - phase, period, &since_slot);
+
+	delay = period - since_slot;
+	while (delay < min_ns)
+		delay += period;
+
+	return nsecs_to_jiffies(delay);
+}
+
+#ifdef CONFIG_DEBUG_FS
+/*
+ * Bus trace recording
+ *
+ * Write "1" to bq27xxx/devices/<battery>/bus_trace to log every bus
+ * transaction in the layout of struct bq27xxx_bus_record, and "0" to
+ * stop. The trace is drained from bus_trace_data; starting a recording
+ * drops whatever was not read yet and opens the stream with a new header.
+ * Backends account transactions from any context, so producers take a
+ * spinlock, while readers and arming serialise on the mutex. The
+ * bq27441_sim "replay" parameter feeds a trace back to the driver.
+ */
+#define BQ27XXX_BUS_TRACE_FIFO	(64 * 1024)
+
+struct bq27xxx_bus_trace {
+	struct bq27xxx_device_info *di;
+	DECLARE_KFIFO_PTR(fifo, u8);
+	struct mutex lock; /* Serialises arming and draining */
+	spinlock_t in_lock; /* Serialises producers */
+	bool active;
+	bool gap; /* Records were dropped since the last one queued */
+	u64 records;
+	u64 dropped;
+};
+
+static void bq27xxx_bus_trace_record(struct bq27xxx_device_info *di, u8 reg,
+				     bool write, const u8 *data, size_t bytes,
+				     int ret, ktime_t start, u64 ns)
+{
+	struct bq27xxx_bus_trace *tr = di->bus_trace;
+	struct bq27xxx_bus_record rec = {
+		.timestamp_ns = ktime_to_ns(start),
+		.duration_ns = min_t(u64, ns, U32_MAX),
+		.result = (write || ret < 0) ? ret : 0,
+		.reg = reg,
+		.flags = write ? BQ27XXX_BUS_WRITE : 0,
+		.len = min_t(size_t, bytes - 1, U8_MAX),
+	};
+	u8 value[2] = { 0 };
+	unsigned long flags;
+
+	if (!tr || !READ_ONCE(tr->active))
+		return;
+
+	/* A read without @data returned its value; failed reads record zeros */
+	if (!write && (!data || ret < 0)) {
+		if (!data && ret >= 0) {
+			value[0] = ret & 0xff;
+			value[1] = ret >> 8;
+		}
+		data = value;
+		rec.len = min_t(u8, rec.len, sizeof(value));
+	}
+
+	spin_lock_irqsave(&tr->in_lock, flags);
+	if (!tr->active) {
+		/* Stopped while we were getting here */
+	} else if (kfifo_avail(&tr->fifo) < sizeof(rec) + rec.len) {
+		tr->dropped++;
+		tr->gap = true;
+	} else {
+		if (tr->gap)
+			rec.flags |= BQ27XXX_BUS_GAP;
+		kfifo_in(&tr->fifo, (u8 *)&rec, sizeof(rec));
+		kfifo_in(&tr->fifo, data, rec.len);
+		tr->records++;
+		tr->gap = false;
+	}
+	spin_unlock_irqrestore(&tr->in_lock, flags);
+}
+
+/* Called with tr->lock held */
+static int bq27xxx_bus_trace_start(struct bq27xxx_bus_trace *tr)
+{
+	struct bq27xxx_bus_trace_header hdr = {
+		.magic = BQ27XXX_BUS_TRACE_MAGIC,
+		.version = BQ27XXX_BUS_TRACE_VERSION,
+		.chip = tr->di->chip,
+	};
+	unsigned long flags;
+	int ret;
+
+	if (!kfifo_initialized(&tr->fifo)) {
+		ret = kfifo_alloc(&tr->fifo, BQ27XXX_BUS_TRACE_FIFO, GFP_KERNEL);
+		if (ret)
+			return ret;
+	}
+
+	spin_lock_irqsave(&tr->in_lock, flags);
+	kfifo_reset(&tr->fifo);
+	kfifo_in(&tr->fifo, (u8 *)&hdr, sizeof(hdr));
+	tr->records = 0;
+	tr->dropped = 0;
+	tr->gap = false;
+	WRITE_ONCE(tr->active, true);
+	spin_unlock_irqrestore(&tr->in_lock, flags);
+
+	return 0;
+}
+
+static void bq27xxx_bus_trace_stop(struct bq27xxx_bus_trace *tr)
+{
+	unsigned long flags;
+
+	spin_lock_irqsave(&tr->in_lock, flags);
+	WRITE_ONCE(tr->active, false);
+	spin_unlock_irqrestore(&tr->in_lock, flags);
+}
+
+static ssize_t bq27xxx_bus_trace_ctl_read(struct file *fp,
+					  char __user *userbuf,
+					  size_t count, loff_t *offset)
+{
+	struct bq27xxx_bus_trace *tr = fp->private_data;
+	unsigned long flags;
+	char buf[128];
+	int ret;
+
+	mutex_lock(&tr->lock);
+	spin_lock_irqsave(&tr->in_lock, flags);
+	ret = scnprintf(buf, sizeof(buf),
+			"active %d\n"
+			"records %llu\n"
+			"dropped %llu\n"
+			"queued_bytes %u\n",
+			tr->active, tr->records, tr->dropped,
+			kfifo_initialized(&tr->fifo) ? kfifo_len(&tr->fifo) : 0);
+	spin_unlock_irqrestore(&tr->in_lock, flags);
+	mutex_unlock(&tr->lock);
+
+	return simple_read_from_buffer(userbuf, count, offset, buf, ret);
+}
+
+static ssize_t bq27xxx_bus_trace_ctl_write(struct file *fp,
+					   const char __user *userbuf,
+					   size_t count, loff_t *offset)
+{
+	struct bq27xxx_bus_trace *tr = fp->private_data;
+	unsigned int enable;
+	int ret;
+
+	ret = kstrtouint_from_user(userbuf, count, 0, &enable);
+	if (ret)
+		return ret;
+
+	mutex_lock(&tr->lock);
+	if (enable)
+		ret = bq27xxx_bus_trace_start(tr);
+	else
+		bq27xxx_bus_trace_stop(tr);
+	mutex_unlock(&tr->lock);
+
+	return ret ? ret : count;
+}
+
+static const struct file_operations bq27xxx_bus_trace_ctl_fops = {
+	.owner = THIS_MODULE,
+	.open = simple_open,
+	.read = bq27xxx_bus_trace_ctl_read,
+	.write = bq27xxx_bus_trace_ctl_write,
+};
+
+/* Drain the byte stream; records are queued whole, so never blocks */
+static ssize_t bq27xxx_bus_trace_data_read(struct file *fp,
+					   char __user *userbuf,
+					   size_t count, loff_t *offset)
+{
+	struct bq27xxx_bus_trace *tr = fp->private_data;
+	unsigned int copied = 0;
+	int ret = 0;
+
+	mutex_lock(&tr->lock);
+	if (kfifo_initialized(&tr->fifo))
+		ret = kfifo_to_user(&tr->fifo, userbuf, count, &copied);
+	mutex_unlock(&tr->lock);
+
+	return ret ? ret : copied;
+}
+
+static const struct file_operations bq27xxx_bus_trace_data_fops = {
+	.owner = THIS_MODULE,
+	.open = simple_open,
+	.read = bq27xxx_bus_trace_data_read,
+	.llseek = no_llseek,
+};
+
+void bq27xxx_bus_trace_create(struct bq27xxx_device_info *di)
+{
+	struct bq27xxx_bus_trace *tr;
+
+	tr = kzalloc(sizeof(*tr), GFP_KERNEL);
+	if (!tr)
+		return;
+
+	tr->di = di;
+	mutex_init(&tr->lock);
+	spin_lock_init(&tr->in_lock);
+
+	debugfs_create_file("bus_trace", S_IRUGO | S_IWUSR, di->dfs_dev_dir,
+			    tr, &bq27xxx_bus_trace_ctl_fops);
+	debugfs_create_file("bus_trace_data", S_IRUSR, di->dfs_dev_dir,
+			    tr, &bq27xxx_bus_trace_data_fops);
+
+	di->bus_trace = tr;
+}
+
+/* Called once the debugfs files are gone and no transaction can start */
+void bq27xxx_bus_trace_destroy(struct bq27xxx_device_info *di)
+{
+	struct bq27xxx_bus_trace *tr = di->bus_trace;
+
+	if (!tr)
+		return;
+
+	di->bus_trace = NULL;
+
+	if (kfifo_initialized(&tr->fifo))
+		kfifo_free(&tr->fifo);
+	mutex_destroy(&tr->lock);
+	kfree(tr);
+}
+#else
+static inline void bq27xxx_bus_trace_record(struct bq27xxx_device_info *di,
+					    u8 reg, bool write, const u8 *data,
+					    size_t bytes, int ret,
+					    ktime_t start, u64 ns) {}
+#endif /* CONFIG_DEBUG_FS */
+
+/*
+ * Bus transaction statistics
+ *
+ * Every transaction made by a bus backend is accounted per operation and
+ * per register. Latencies go into log2 histograms: bucket 0 counts
+ * transactions under 1 us, bucket n those of [2^(n-1), 2^n) us, and the
+ * last bucket everything slower. Writing to
+ * bq27xxx/devices/<battery>/bus_stats resets the counters.
+ */
+#define BQ27XXX_HIST_BUCKETS	20
+
+enum bq27xxx_bus_op {
+	BQ27XXX_OP_READ8 = 0,
+	BQ27XXX_OP_READ16,
+	BQ27XXX_OP_WRITE,
+	BQ27XXX_BUS_OPS,
+};
+
+static const char * const bq27xxx_bus_op_names[BQ27XXX_BUS_OPS] = {
+	"read8", "read16", "write",
+};
+
+struct bq27xxx_op_stats {
+	u64 count;
+	u64 bytes;
+	u64 errors;
+	u64 retries;
+	u64 total_ns;
+	u64 max_ns;
+	u32 hist[BQ27XXX_HIST_BUCKETS];
+};
+
+struct bq27xxx_reg_stats {
+	u32 reads;
+	u32 writes;
+	u32 errors;
+	u64 total_ns;
+};
+
+struct bq27xxx_bus_stats {
+	spinlock_t lock;
+	ktime_t epoch;
+	struct bq27xxx_op_stats op[BQ27XXX_BUS_OPS];
+	struct bq27xxx_reg_stats reg[256];
+};
+
+/*
+ * Account one transaction that began at @start. @bytes counts the
+ * register byte and the data; @retries counts repeated bus reads.
+ * @data holds the bytes after the register byte, or is NULL for a read
+ * whose value is @ret.
+ */
+void bq27xxx_bus_account(struct bq27xxx_device_info *di, u8 reg,
+			 bool write, const u8 *data, size_t bytes, int ret,
+			 unsigned int retries, ktime_t start)
+{
+	struct bq27xxx_bus_stats *stats = di->bus_stats;
+	u64 ns = ktime_to_ns(ktime_sub(ktime_get(), start));
+	u64 us = div_u64(ns, NSEC_PER_USEC);
+	struct bq27xxx_op_stats *op;
+	struct bq27xxx_reg_stats *r;
+	unsigned long flags;
+
+	if (write)
+		trace_bq27xxx_reg_write(di->dev, reg, bytes, ret, ns);
+	else
+		trace_bq27xxx_reg_read(di->dev, reg, bytes, ret, ns);
+
+	atomic64_add(ns, &di->bus_ns);
+	atomic_inc(&di->bus_ops);
+
+	bq27xxx_bus_trace_record(di, reg, write, data, bytes, ret, start, ns);
+
+	if (!stats)
+		return;
+
+	if (write)
+		op = &stats->op[BQ27XXX_OP_WRITE];
+	else if (bytes > 2)
+		op = &stats->op[BQ27XXX_OP_READ16];
+	else
+		op = &stats->op[BQ27XXX_OP_READ8];
+	r = &stats->reg[reg];
+
+	spin_lock_irqsave(&stats->lock, flags);
+	op->count++;
+	op->bytes += bytes;
+	op->retries += retries;
+	op->total_ns += ns;
+	if (ns > op->max_ns)
+		op->max_ns = ns;
+	op->hist[min_t(unsigned int, us ? fls64(us) : 0,
+		       BQ27XXX_HIST_BUCKETS - 1)]++;
+	if (write)
+		r->writes++;
+	else
+		r->reads++;
+	r->total_ns += ns;
+	if (ret < 0) {
+		op->errors++;
+		r->errors++;
+	}
+	spin_unlock_irqrestore(&stats->lock, flags);
+}
+EXPORT_SYMBOL_GPL(bq27xxx_bus_account);
+
+#ifdef CONFIG_DEBUG_FS
+static int bq27xxx_bus_stats_show(struct seq_file *s, void *data)
+{
+	struct bq27xxx_device_info *di = s->private;
+	struct bq27xxx_bus_stats *copy;
+	u64 elapsed_ms, bus_ns = 0;
+	unsigned long flags;
+	int i, b;
+
+	copy = kmalloc(sizeof(*copy), GFP_KERNEL);
+	if (!copy)
+		return -ENOMEM;
+
+	spin_lock_irqsave(&di->bus_stats->lock, flags);
+	*copy = *di->bus_stats;
+	spin_unlock_irqrestore(&di->bus_stats->lock, flags);
+
+	for (i = 0; i < BQ27XXX_BUS_OPS; i++)
+		bus_ns += copy->op[i].total_ns;
+	elapsed_ms = max_t(s64, 1, ktime_ms_delta(ktime_get(), copy->epoch));
+
+	seq_printf(s, "elapsed_ms %llu\nbus_us %llu\nbus_us_per_hour %llu\n",
+		   elapsed_ms, div_u64(bus_ns, NSEC_PER_USEC),
+		   div64_u64(div_u64(bus_ns, NSEC_PER_USEC) * 3600 * MSEC_PER_SEC,
+			     elapsed_ms));
+
+	for (i = 0; i < BQ27XXX_BUS_OPS; i++) {
+		struct bq27xxx_op_stats *op = &copy->op[i];
+
+		seq_printf(s, "%s count %llu bytes %llu errors %llu retries %llu "
+			   "total_us %llu max_us %llu\n  hist_log2_us",
+			   bq27xxx_bus_op_names[i], op->count, op->bytes,
+			   op->errors, op->retries,
+			   div_u64(op->total_ns, NSEC_PER_USEC),
+			   div_u64(op->max_ns, NSEC_PER_USEC));
+		for (b = 0; b < BQ27XXX_HIST_BUCKETS; b++)
+			seq_printf(s, " %u", op->hist[b]);
+		seq_puts(s, "\n");
+	}
+
+	for (i = 0; i < ARRAY_SIZE(copy->reg); i++) {
+		struct bq27xxx_reg_stats *r = &copy->reg[i];
+
+		if (!r->reads && !r->writes)
+			continue;
+		seq_printf(s, "reg 0x%02x reads %u writes %u errors %u total_us %llu\n",
+			   i, r->reads, r->writes, r->errors,
+			   div_u64(r->total_ns, NSEC_PER_USEC));
+	}
+
+	kfree(copy);
+
+	return 0;
+}
+
+static int bq27xxx_bus_stats_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, bq27xxx_bus_stats_show, inode->i_private);
+}
+
+/* Any write resets the counters */
+static ssize_t bq27xxx_bus_stats_reset(struct file *file,
+				       const char __user *userbuf,
+				       size_t count, loff_t *ppos)
+{
+	struct seq_file *s = file->private_data;
+	struct bq27xxx_device_info *di = s->private;
+	struct bq27xxx_bus_stats *stats = di->bus_stats;
+	unsigned long flags;
+
+	spin_lock_irqsave(&stats->lock, flags);
+	memset(stats->op, 0, sizeof(stats->op));
+	memset(stats->reg, 0, sizeof(stats->reg));
+	stats->epoch = ktime_get();
+	spin_unlock_irqrestore(&stats->lock, flags);
+
+	return count;
+}
+
+static const struct file_operations bq27xxx_dev_bus_stats_fops = {
+	.owner = THIS_MODULE,
+	.open = bq27xxx_bus_stats_open,
+	.read = seq_read,
+	.write = bq27xxx_bus_stats_reset,
+	.llseek = seq_lseek,
+	.release = single_release,
+};
+#endif /* CONFIG_DEBUG_FS */
+
+#ifdef CONFIG_DEBUG_FS
+static const char * const bq27xxx_probe_phase_names[BQ27XXX_PROBE_PHASES] = {
+	[BQ27XXX_PROBE_ALLOC] = "alloc",
+	[BQ27XXX_PROBE_PSY_REGISTER] = "psy_register",
+	[BQ27XXX_PROBE_INTERFACES] = "interfaces",
+	[BQ27XXX_PROBE_VOLTAGE] = "voltage",
+	[BQ27XXX_PROBE_FW_VERSION] = "fw_version",
+	[BQ27XXX_PROBE_FLAGS] = "flags",
+	[BQ27XXX_PROBE_DM_CODE] = "dm_code",
+	[BQ27XXX_PROBE_CONFIGURE] = "configure",
+	[BQ27XXX_PROBE_FIRST_UPDATE] = "first_update",
+};
+
+static int bq27xxx_probe_timing_show(struct seq_file *s, void *data)
+{
+	struct bq27xxx_device_info *di = s->private;
+	struct bq27xxx_probe_timing *t = &di->probe;
+	s64 bus_ns = 0;
+	int i, bus_ops = 0;
+
+	for (i = 0; i < BQ27XXX_PROBE_PHASES; i++) {
+		seq_printf(s, "%-12s time_us %lld bus_us %lld bus_ops %d\n",
+			   bq27xxx_probe_phase_names[i], t->us[i],
+			   div_s64(t->bus_ns[i], NSEC_PER_USEC), t->bus_ops[i]);
+		bus_ns += t->bus_ns[i];
+		bus_ops += t->bus_ops[i];
+	}
+
+	seq_printf(s, "%-12s time_us %lld bus_us %lld bus_ops %d\n", "total",
+		   ktime_us_delta(t->mark, t->start),
+		   div_s64(bus_ns, NSEC_PER_USEC), bus_ops);
+
+	return 0;
+}
+
+static int bq27xxx_probe_timing_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, bq27xxx_probe_timing_show, inode->i_private);
+}
+
+static const struct file_operations bq27xxx_probe_timing_fops = {
+	.owner = THIS_MODULE,
+	.open = bq27xxx_probe_timing_open,
+	.read = seq_read,
+	.llseek = seq_lseek,
+	.release = single_release,
+};
+#endif /* CONFIG_DEBUG_FS */
+
+#ifdef CONFIG_DEBUG_FS
+static const char * const bq27xxx_lock_site_names[BQ27XXX_LOCK_SITES] = {
+	[BQ27XXX_LOCK_UPDATE] = "update",
+	[BQ27XXX_LOCK_PROPERTY] = "property",
+	[BQ27XXX_LOCK_DEBUGFS] = "debugfs",
+	[BQ27XXX_LOCK_CONFIG] = "config",
+	[BQ27XXX_LOCK_IRQ] = "irq",
+	[BQ27XXX_LOCK_SAMPLE] = "sample",
+	[BQ27XXX_LOCK_OTHER] = "other",
+};
+
+static int bq27xxx_lock_stats_show(struct seq_file *s, void *data)
+{
+	struct bq27xxx_device_info *di = s->private;
+	struct bq27xxx_lock_stats copy[BQ27XXX_LOCK_SITES];
+	int i;
+
+	spin_lock(&di->lock_stats_lock);
+	memcpy(copy, di->lock_stats, sizeof(copy));
+	spin_unlock(&di->lock_stats_lock);
+
+	for (i = 0; i < BQ27XXX_LOCK_SITES; i++) {
+		struct bq27xxx_lock_stats *st = &copy[i];
+
+		seq_printf(s, "%-8s acquired %llu contended %llu skipped %llu "
+			   "wait_us %llu wait_max_us %llu "
+			   "hold_us %llu hold_max_us %llu\n",
+			   bq27xxx_lock_site_names[i], st->acquired,
+			   st->contended, st->skipped,
+			   div_u64(st->wait_total_ns, NSEC_PER_USEC),
+			   div_u64(st->wait_max_ns, NSEC_PER_USEC),
+			   div_u64(st->hold_total_ns, NSEC_PER_USEC),
+			   div_u64(st->hold_max_ns, NSEC_PER_USEC));
+	}
+
+	return 0;
+}
+
+static int bq27xxx_lock_stats_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, bq27xxx_lock_stats_show, inode->i_private);
+}
+
+/* Any write resets the counters */
+static ssize_t bq27xxx_lock_stats_reset(struct file *file,
+					const char __user *userbuf,
+					size_t count, loff_t *ppos)
+{
+	struct seq_file *s = file->private_data;
+	struct bq27xxx_device_info *di = s->private;
+
+	spin_lock(&di->lock_stats_lock);
+	memset(di->lock_stats, 0, sizeof(di->lock_stats));
+	spin_unlock(&di->lock_stats_lock);
+
+	return count;
+}
+
+static const struct file_operations bq27xxx_lock_stats_fops = {
+	.owner = THIS_MODULE,
+	.open = bq27xxx_lock_stats_open,
+	.read = seq_read,
+	.write = bq27xxx_lock_stats_reset,
+	.llseek = seq_lseek,
+	.release = single_release,
+};
+#endif /* CONFIG_DEBUG_FS */
+
+void bq27xxx_bus_stats_create(struct bq27xxx_device_info *di)
+{
+	struct bq27xxx_bus_stats *stats;
+
+	stats = kzalloc(sizeof(*stats), GFP_KERNEL);
+	if (!stats)
+		return;
+
+	spin_lock_init(&stats->lock);
+	stats->epoch = ktime_get();
+	di->bus_stats = stats;
+
+#ifdef CONFIG_DEBUG_FS
+	debugfs_create_file("bus_stats", S_IRUGO | S_IWUSR, di->dfs_dev_dir,
+			    di, &bq27xxx_dev_bus_stats_fops);
+#endif /* CONFIG_DEBUG_FS */
+}
+
+/* These live in di itself, so unlike bus_stats they cannot fail */
+void bq27xxx_dev_debugfs_create(struct bq27xxx_device_info *di)
+{
+#ifdef CONFIG_DEBUG_FS
+	debugfs_create_file("probe_timing", S_IRUGO, di->dfs_dev_dir,
+			    di, &bq27xxx_probe_timing_fops);
+	debugfs_create_file("lock_stats", S_IRUGO | S_IWUSR, di->dfs_dev_dir,
+			    di, &bq27xxx_lock_stats_fops);
+#endif /* CONFIG_DEBUG_FS */
+}
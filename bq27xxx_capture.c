@@ -0,0 +1,309 @@
+/*
+ * BQ27xxx battery driver - high-rate capture
+ *
+ * This package is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * THIS PACKAGE IS PROVIDED ``AS IS'' AND WITHOUT ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, WITHOUT LIMITATION, THE IMPLIED
+ * WARRANTIES OF MERCHANTIBILITY AND FITNESS FOR A PARTICULAR PURPOSE.
+ */
+
+#include <linux/module.h>
+#include <linux/workqueue.h>
+#include <linux/slab.h>
+#include <linux/mutex.h>
+#include <linux/math64.h>
+#include <linux/debugfs.h>
+#include <linux/uaccess.h>
+#include <linux/hrtimer.h>
+#include <linux/kfifo.h>
+#include <linux/power_supply.h>
+
+#include "bq27xxx_battery.h"
+#include "bq27xxx_internal.h"
+#include "bq27xxx_snapshot.h"
+
+#define BQ27XXX_CAPTURE_MAX_HZ		100
+#define BQ27XXX_CAPTURE_MAX_MS		600000
+#define BQ27XXX_CAPTURE_FIFO		1024 /* Samples; about 10 s at 100 Hz */
+
+#ifdef CONFIG_DEBUG_FS
+/*
+ * High-rate capture
+ *
+ * Write "<rate_hz> <duration_ms>" to bq27xxx/devices/<battery>/capture
+ * to sample average current, voltage and average power for a bounded
+ * window, and "0" to stop early. The hrtimer only kicks the sampling
+ * work, since the bus may sleep. Samples go into a kfifo with one
+ * producer (the work) and one consumer (capture_data readers), so
+ * neither side takes a lock against the other.
+ */
+struct bq27xxx_capture {
+	struct bq27xxx_device_info *di;
+	struct hrtimer timer;
+	struct work_struct work;
+	DECLARE_KFIFO_PTR(fifo, struct bq27xxx_sample);
+	struct mutex lock; /* Serialises arming and draining */
+	ktime_t period;
+	ktime_t end;
+	unsigned int rate_hz;
+	bool active;
+	u64 samples;
+	u64 overruns; /* Samples dropped on a full FIFO */
+	atomic64_t missed; /* Ticks dropped: gauge busy or sample pending */
+};
+
+static enum hrtimer_restart bq27xxx_capture_tick(struct hrtimer *timer)
+{
+	struct bq27xxx_capture *cap =
+			container_of(timer, struct bq27xxx_capture, timer);
+
+	if (ktime_after(ktime_get(), cap->end)) {
+		WRITE_ONCE(cap->active, false);
+		return HRTIMER_NORESTART;
+	}
+
+	if (!queue_work(bq27xxx_urgent_wq, &cap->work))
+		atomic64_inc(&cap->missed);
+
+	hrtimer_forward_now(timer, cap->period);
+
+	return HRTIMER_RESTART;
+}
+
+static void bq27xxx_capture_work(struct work_struct *work)
+{
+	struct bq27xxx_capture *cap =
+			container_of(work, struct bq27xxx_capture, work);
+	struct bq27xxx_device_info *di = cap->di;
+	struct bq27xxx_sample sample = {
+		.timestamp_ns = ktime_get_ns(),
+	};
+	struct bq27xxx_bus_group *group;
+	ktime_t bus_start;
+	int curr, volt, power = -ENODATA;
+
+	if (READ_ONCE(di->suspended)) {
+		atomic64_inc(&cap->missed);
+		return;
+	}
+
+	/* Leave the bus alone while a config session or update holds it */
+	if (!bq27xxx_trylock(di, BQ27XXX_LOCK_SAMPLE)) {
+		bq27xxx_lock_skipped(di, BQ27XXX_LOCK_SAMPLE);
+		atomic64_inc(&cap->missed);
+		return;
+	}
+
+	if (bq27xxx_pm_get(di) < 0) {
+		bq27xxx_pm_put(di);
+		bq27xxx_unlock(di);
+		atomic64_inc(&cap->missed);
+		return;
+	}
+
+	group = bq27xxx_bus_claim(di, &bus_start);
+	curr = bq27xxx_read(di, BQ27XXX_REG_AI, false);
+	volt = bq27xxx_read(di, BQ27XXX_REG_VOLT, false);
+	if (di->regs[BQ27XXX_REG_AP] != INVALID_REG_ADDR)
+		power = bq27xxx_battery_read_pwr_avg(di);
+	bq27xxx_bus_release(group, bus_start);
+	bq27xxx_pm_put(di);
+	bq27xxx_unlock(di);
+
+	sample.current_ua = curr < 0 ? curr :
+		bq27xxx_battery_current_ua(di, READ_ONCE(di->cache.flags), curr);
+	sample.voltage_uv = volt < 0 ? volt : volt * 1000;
+	sample.power_avg_uw = power;
+
+	if (kfifo_put(&cap->fifo, sample))
+		cap->samples++;
+	else
+		cap->overruns++;
+}
+
+/* Called with cap->lock held */
+static void bq27xxx_capture_stop(struct bq27xxx_capture *cap)
+{
+	WRITE_ONCE(cap->active, false);
+	hrtimer_cancel(&cap->timer);
+	cancel_work_sync(&cap->work);
+}
+
+/* Called with cap->lock held; any previous capture and its data are dropped */
+static int bq27xxx_capture_start(struct bq27xxx_capture *cap,
+				 unsigned int rate_hz, unsigned int duration_ms)
+{
+	int ret;
+
+	bq27xxx_capture_stop(cap);
+
+	if (!kfifo_initialized(&cap->fifo)) {
+		ret = kfifo_alloc(&cap->fifo, BQ27XXX_CAPTURE_FIFO, GFP_KERNEL);
+		if (ret)
+			return ret;
+	}
+
+	kfifo_reset(&cap->fifo);
+	cap->samples = 0;
+	cap->overruns = 0;
+	atomic64_set(&cap->missed, 0);
+	cap->rate_hz = rate_hz;
+	cap->period = ns_to_ktime(div_u64(NSEC_PER_SEC, rate_hz));
+	cap->end = ktime_add_ms(ktime_get(), duration_ms);
+	WRITE_ONCE(cap->active, true);
+
+	queue_work(bq27xxx_urgent_wq, &cap->work);
+	hrtimer_start(&cap->timer, cap->period, HRTIMER_MODE_REL);
+
+	return 0;
+}
+
+static ssize_t bq27xxx_capture_ctl_read(struct file *fp, char __user *userbuf,
+					size_t count, loff_t *offset)
+{
+	struct bq27xxx_capture *cap = fp->private_data;
+	char buf[256];
+	s64 remaining_ms = 0;
+	int ret;
+
+	mutex_lock(&cap->lock);
+	if (READ_ONCE(cap->active))
+		remaining_ms = max_t(s64, 0,
+				     ktime_ms_delta(cap->end, ktime_get()));
+
+	ret = scnprintf(buf, sizeof(buf),
+			"active %d\n"
+			"rate_hz %u\n"
+			"remaining_ms %lld\n"
+			"samples %llu\n"
+			"queued %u\n"
+			"overruns %llu\n"
+			"missed %llu\n",
+			READ_ONCE(cap->active), cap->rate_hz, remaining_ms,
+			cap->samples,
+			kfifo_initialized(&cap->fifo) ? kfifo_len(&cap->fifo) : 0,
+			cap->overruns, (u64)atomic64_read(&cap->missed));
+	mutex_unlock(&cap->lock);
+
+	return simple_read_from_buffer(userbuf, count, offset, buf, ret);
+}
+
+static ssize_t bq27xxx_capture_ctl_write(struct file *fp,
+					 const char __user *userbuf,
+					 size_t count, loff_t *offset)
+{
+	struct bq27xxx_capture *cap = fp->private_data;
+	unsigned int rate_hz, duration_ms = 0;
+	char buf[32];
+	int ret;
+
+	if (count >= sizeof(buf))
+		return -EINVAL;
+	if (copy_from_user(buf, userbuf, count))
+		return -EFAULT;
+	buf[count] = '\0';
+
+	if (sscanf(buf, "%u %u", &rate_hz, &duration_ms) < 1)
+		return -EINVAL;
+
+	if (rate_hz && (rate_hz > BQ27XXX_CAPTURE_MAX_HZ || !duration_ms ||
+			duration_ms > BQ27XXX_CAPTURE_MAX_MS))
+		return -EINVAL;
+
+	mutex_lock(&cap->lock);
+	if (rate_hz) {
+		ret = bq27xxx_capture_start(cap, rate_hz, duration_ms);
+	} else {
+		bq27xxx_capture_stop(cap);
+		ret = 0;
+	}
+	mutex_unlock(&cap->lock);
+
+	return ret ? ret : count;
+}
+
+static const struct file_operations bq27xxx_capture_ctl_fops = {
+	.owner = THIS_MODULE,
+	.open = simple_open,
+	.read = bq27xxx_capture_ctl_read,
+	.write = bq27xxx_capture_ctl_write,
+};
+
+/* Drain whole struct bq27xxx_sample records; never blocks */
+static ssize_t bq27xxx_capture_data_read(struct file *fp,
+					 char __user *userbuf,
+					 size_t count, loff_t *offset)
+{
+	struct bq27xxx_capture *cap = fp->private_data;
+	unsigned int copied = 0;
+	int ret = 0;
+
+	mutex_lock(&cap->lock);
+	if (kfifo_initialized(&cap->fifo))
+		ret = kfifo_to_user(&cap->fifo, userbuf, count, &copied);
+	mutex_unlock(&cap->lock);
+
+	return ret ? ret : copied;
+}
+
+static const struct file_operations bq27xxx_capture_data_fops = {
+	.owner = THIS_MODULE,
+	.open = simple_open,
+	.read = bq27xxx_capture_data_read,
+	.llseek = no_llseek,
+};
+
+void bq27xxx_capture_create(struct bq27xxx_device_info *di)
+{
+	struct bq27xxx_capture *cap;
+
+	cap = kzalloc(sizeof(*cap), GFP_KERNEL);
+	if (!cap)
+		return;
+
+	cap->di = di;
+	mutex_init(&cap->lock);
+	hrtimer_init(&cap->timer, CLOCK_MONOTONIC, HRTIMER_MODE_REL);
+	cap->timer.function = bq27xxx_capture_tick;
+	INIT_WORK(&cap->work, bq27xxx_capture_work);
+
+	debugfs_create_file("capture", S_IRUGO | S_IWUSR, di->dfs_dev_dir,
+			    cap, &bq27xxx_capture_ctl_fops);
+	debugfs_create_file("capture_data", S_IRUSR, di->dfs_dev_dir,
+			    cap, &bq27xxx_capture_data_fops);
+
+	di->capture = cap;
+}
+
+/* Stop a running capture; the samples taken so far stay readable */
+void bq27xxx_capture_suspend(struct bq27xxx_device_info *di)
+{
+	struct bq27xxx_capture *cap = di->capture;
+
+	if (!cap)
+		return;
+
+	mutex_lock(&cap->lock);
+	bq27xxx_capture_stop(cap);
+	mutex_unlock(&cap->lock);
+}
+
+void bq27xxx_capture_destroy(struct bq27xxx_device_info *di)
+{
+	struct bq27xxx_capture *cap = di->capture;
+
+	if (!cap)
+		return;
+
+	bq27xxx_capture_suspend(di);
+	di->capture = NULL;
+
+	if (kfifo_initialized(&cap->fifo))
+		kfifo_free(&cap->fifo);
+	mutex_destroy(&cap->lock);
+	kfree(cap);
+}
+#endif /* CONFIG_DEBUG_FS */
@@ -0,0 +1,2255 @@
+/*
+ * BQ27xxx battery driver
+ *
+ * Copyright (C) 2008 Rodolfo Giometti <giometti@linux.it>
+ * Copyright (C) 2008 Eurotech S.p.A. <info@eurotech.it>
+ * Copyright (C) 2010-2011 Lars-Peter Clausen <lars@metafoo.de>
+ * Copyright (C) 2011 Pali Rohár <pali.rohar@gmail.com>
+ *
+ * Based on a previous work by Copyright (C) 2008 Texas Instruments, Inc.
+ *
+ * This package is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * THIS PACKAGE IS PROVIDED ``AS IS'' AND WITHOUT ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, WITHOUT LIMITATION, THE IMPLIED
+ * WARRANTIES OF MERCHANTIBILITY AND FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * Datasheets:
+ * http://www.ti.com/product/bq27000
+ * http://www.ti.com/product/bq27200
+ * http://www.ti.com/product/bq27010
+ * http://www.ti.com/product/bq27210
+ * http://www.ti.com/product/bq27500
+ * http://www.ti.com/product/bq27510-g3
+ * http://www.ti.com/product/bq27520-g4
+ * http://www.ti.com/product/bq27530-g1
+ * http://www.ti.com/product/bq27531-g1
+ * http://www.ti.com/product/bq27541-g1
+ * http://www.ti.com/product/bq27542-g1
+ * http://www.ti.com/product/bq27546-g1
+ * http://www.ti.com/product/bq27742-g1
+ * http://www.ti.com/product/bq27545-g1
+ * http://www.ti.com/product/bq27421-g1
+ * http://www.ti.com/product/bq27425-g1
+ * http://www.ti.com/product/bq27411-g1
+ * http://www.ti.com/product/bq27621-g1
+ */
+
+#include <linux/device.h>
+#include <linux/module.h>
+#include <linux/param.h>
+#include <linux/jiffies.h>
+#include <linux/workqueue.h>
+#include <linux/delay.h>
+#include <linux/platform_device.h>
+#include <linux/power_supply.h>
+#include <linux/slab.h>
+#include <linux/of.h>
+#include <linux/seqlock.h>
+#include <linux/ktime.h>
+#include <linux/sysfs.h>
+#include <linux/math64.h>
+#include <linux/debugfs.h>
+
+#include "bq27xxx_battery.h"
+#include "bq27xxx_internal.h"
+#include "bq27xxx_snapshot.h"
+#include "bq27441_battery.h"
+
+#define CREATE_TRACE_POINTS
+#include "bq27xxx_trace.h"
+
+#define DRIVER_VERSION		"1.2.0"
+
+#define BQ27XXX_MANUFACTURER	"Texas Instruments"
+
+/* BQ27XXX Flags */
+#define BQ27XXX_FLAG_DSC	BIT(0)
+#define BQ27XXX_FLAG_SOCF	BIT(1) /* State-of-Charge threshold final */
+#define BQ27XXX_FLAG_SOC1	BIT(2) /* State-of-Charge threshold 1 */
+#define BQ27XXX_FLAG_FC		BIT(9)
+#define BQ27XXX_FLAG_OTD	BIT(14)
+#define BQ27XXX_FLAG_OTC	BIT(15)
+#define BQ27XXX_FLAG_UT		BIT(14)
+#define BQ27XXX_FLAG_OT		BIT(15)
+
+/* BQ27000 has different layout for Flags register */
+#define BQ27000_FLAG_EDVF	BIT(0) /* Final End-of-Discharge-Voltage flag */
+#define BQ27000_FLAG_EDV1	BIT(1) /* First End-of-Discharge-Voltage flag */
+#define BQ27000_FLAG_CI		BIT(4) /* Capacity Inaccurate flag */
+#define BQ27000_FLAG_FC		BIT(5)
+#define BQ27000_FLAG_CHGS	BIT(7) /* Charge state flag */
+
+#define BQ27XXX_IRQ_DEBOUNCE_MS	200 /* Coalescing window for IRQ bursts */
+#define BQ27XXX_REFRESH_TIMEOUT_MS	500 /* Longest snapshot_read waits */
+
+/* Default change-detection thresholds */
+#define BQ27XXX_NOTIFY_VOLTAGE_MV	20
+#define BQ27XXX_NOTIFY_TEMP_DC		10 /* 0.1 degree units */
+#define BQ27XXX_NOTIFY_INTERVAL_MS	1000 /* Minimum gap between uevents */
+
+/* Register mappings */
+static u8 bq27000_regs[] = {
+	0x00,	/* CONTROL	*/
+	0x06,	/* TEMP		*/
+	INVALID_REG_ADDR,	/* INT TEMP - NA*/
+	0x08,	/* VOLT		*/
+	0x14,	/* AVG CURR	*/
+	0x0a,	/* FLAGS	*/
+	0x16,	/* TTE		*/
+	0x18,	/* TTF		*/
+	0x1c,	/* TTES		*/
+	0x26,	/* TTECP	*/
+	0x0c,	/* NAC		*/
+	0x12,	/* LMD(FCC)	*/
+	0x2a,	/* CYCT		*/
+	0x22,	/* AE		*/
+	0x0b,	/* SOC(RSOC)	*/
+	0x76,	/* DCAP(ILMD)	*/
+	0x24,	/* AP		*/
+};
+
+static u8 bq27010_regs[] = {
+	0x00,	/* CONTROL	*/
+	0x06,	/* TEMP		*/
+	INVALID_REG_ADDR,	/* INT TEMP - NA*/
+	0x08,	/* VOLT		*/
+	0x14,	/* AVG CURR	*/
+	0x0a,	/* FLAGS	*/
+	0x16,	/* TTE		*/
+	0x18,	/* TTF		*/
+	0x1c,	/* TTES		*/
+	0x26,	/* TTECP	*/
+	0x0c,	/* NAC		*/
+	0x12,	/* LMD(FCC)	*/
+	0x2a,	/* CYCT		*/
+	INVALID_REG_ADDR,	/* AE - NA	*/
+	0x0b,	/* SOC(RSOC)	*/
+	0x76,	/* DCAP(ILMD)	*/
+	INVALID_REG_ADDR,	/* AP - NA	*/
+};
+
+static u8 bq27500_regs[] = {
+	0x00,	/* CONTROL	*/
+	0x06,	/* TEMP		*/
+	0x28,	/* INT TEMP	*/
+	0x08,	/* VOLT		*/
+	0x14,	/* AVG CURR	*/
+	0x0a,	/* FLAGS	*/
+	0x16,	/* TTE		*/
+	INVALID_REG_ADDR,	/* TTF - NA	*/
+	0x1a,	/* TTES		*/
+	INVALID_REG_ADDR,	/* TTECP - NA	*/
+	0x0c,	/* NAC		*/
+	0x12,	/* LMD(FCC)	*/
+	0x2a,	/* CYCT		*/
+	INVALID_REG_ADDR,	/* AE - NA	*/
+	0x2c,	/* SOC(RSOC)	*/
+	0x3c,	/* DCAP(ILMD)	*/
+	INVALID_REG_ADDR,	/* AP - NA	*/
+};
+
+static u8 bq27530_regs[] = {
+	0x00,	/* CONTROL	*/
+	0x06,	/* TEMP		*/
+	0x32,	/* INT TEMP	*/
+	0x08,	/* VOLT		*/
+	0x14,	/* AVG CURR	*/
+	0x0a,	/* FLAGS	*/
+	0x16,	/* TTE		*/
+	INVALID_REG_ADDR,	/* TTF - NA	*/
+	INVALID_REG_ADDR,	/* TTES - NA	*/
+	INVALID_REG_ADDR,	/* TTECP - NA	*/
+	0x0c,	/* NAC		*/
+	0x12,	/* LMD(FCC)	*/
+	0x2a,	/* CYCT		*/
+	INVALID_REG_ADDR,	/* AE - NA	*/
+	0x2c,	/* SOC(RSOC)	*/
+	INVALID_REG_ADDR,	/* DCAP - NA	*/
+	0x24,	/* AP		*/
+};
+
+static u8 bq27541_regs[] = {
+	0x00,	/* CONTROL	*/
+	0x06,	/* TEMP		*/
+	0x28,	/* INT TEMP	*/
+	0x08,	/* VOLT		*/
+	0x14,	/* AVG CURR	*/
+	0x0a,	/* FLAGS	*/
+	0x16,	/* TTE		*/
+	INVALID_REG_ADDR,	/* TTF - NA	*/
+	INVALID_REG_ADDR,	/* TTES - NA	*/
+	INVALID_REG_ADDR,	/* TTECP - NA	*/
+	0x0c,	/* NAC		*/
+	0x12,	/* LMD(FCC)	*/
+	0x2a,	/* CYCT		*/
+	INVALID_REG_ADDR,	/* AE - NA	*/
+	0x2c,	/* SOC(RSOC)	*/
+	0x3c,	/* DCAP		*/
+	0x24,	/* AP		*/
+};
+
+static u8 bq27545_regs[] = {
+	0x00,	/* CONTROL	*/
+	0x06,	/* TEMP		*/
+	0x28,	/* INT TEMP	*/
+	0x08,	/* VOLT		*/
+	0x14,	/* AVG CURR	*/
+	0x0a,	/* FLAGS	*/
+	0x16,	/* TTE		*/
+	INVALID_REG_ADDR,	/* TTF - NA	*/
+	INVALID_REG_ADDR,	/* TTES - NA	*/
+	INVALID_REG_ADDR,	/* TTECP - NA	*/
+	0x0c,	/* NAC		*/
+	0x12,	/* LMD(FCC)	*/
+	0x2a,	/* CYCT		*/
+	INVALID_REG_ADDR,	/* AE - NA	*/
+	0x2c,	/* SOC(RSOC)	*/
+	INVALID_REG_ADDR,	/* DCAP - NA */
+	0x24,	/* AP		*/
+};
+
+static u8 bq27421_regs[] = {
+	0x00,	/* CONTROL	*/
+	0x02,	/* TEMP		*/
+	0x1e,	/* INT TEMP	*/
+	0x04,	/* VOLT		*/
+	0x10,	/* AVG CURR	*/
+	0x06,	/* FLAGS	*/
+	INVALID_REG_ADDR,	/* TTE - NA	*/
+	INVALID_REG_ADDR,	/* TTF - NA	*/
+	INVALID_REG_ADDR,	/* TTES - NA	*/
+	INVALID_REG_ADDR,	/* TTECP - NA	*/
+	0x08,	/* NAC		*/
+	0x0e,	/* FCC		*/
+	INVALID_REG_ADDR,	/* CYCT - NA	*/
+	INVALID_REG_ADDR,	/* AE - NA	*/
+	0x1c,	/* SOC		*/
+	0x3c,	/* DCAP		*/
+	0x18,	/* AP		*/
+};
+
+static u8 *bq27xxx_regs[] = {
+	[BQ27000] = bq27000_regs,
+	[BQ27010] = bq27010_regs,
+	[BQ27500] = bq27500_regs,
+	[BQ27530] = bq27530_regs,
+	[BQ27541] = bq27541_regs,
+	[BQ27545] = bq27545_regs,
+	[BQ27421] = bq27421_regs,
+};
+
+static enum power_supply_property bq27000_battery_props[] = {
+	POWER_SUPPLY_PROP_STATUS,
+	POWER_SUPPLY_PROP_PRESENT,
+	POWER_SUPPLY_PROP_VOLTAGE_NOW,
+	POWER_SUPPLY_PROP_CURRENT_NOW,
+	POWER_SUPPLY_PROP_CAPACITY,
+	POWER_SUPPLY_PROP_CAPACITY_LEVEL,
+	POWER_SUPPLY_PROP_TEMP,
+	POWER_SUPPLY_PROP_TIME_TO_EMPTY_NOW,
+	POWER_SUPPLY_PROP_TIME_TO_EMPTY_AVG,
+	POWER_SUPPLY_PROP_TIME_TO_FULL_NOW,
+	POWER_SUPPLY_PROP_TECHNOLOGY,
+	POWER_SUPPLY_PROP_CHARGE_FULL,
+	POWER_SUPPLY_PROP_CHARGE_NOW,
+	POWER_SUPPLY_PROP_CHARGE_FULL_DESIGN,
+	POWER_SUPPLY_PROP_CYCLE_COUNT,
+	POWER_SUPPLY_PROP_ENERGY_NOW,
+	POWER_SUPPLY_PROP_POWER_AVG,
+	POWER_SUPPLY_PROP_HEALTH,
+	POWER_SUPPLY_PROP_MANUFACTURER,
+};
+
+static enum power_supply_property bq27010_battery_props[] = {
+	POWER_SUPPLY_PROP_STATUS,
+	POWER_SUPPLY_PROP_PRESENT,
+	POWER_SUPPLY_PROP_VOLTAGE_NOW,
+	POWER_SUPPLY_PROP_CURRENT_NOW,
+	POWER_SUPPLY_PROP_CAPACITY,
+	POWER_SUPPLY_PROP_CAPACITY_LEVEL,
+	POWER_SUPPLY_PROP_TEMP,
+	POWER_SUPPLY_PROP_TIME_TO_EMPTY_NOW,
+	POWER_SUPPLY_PROP_TIME_TO_EMPTY_AVG,
+	POWER_SUPPLY_PROP_TIME_TO_FULL_NOW,
+	POWER_SUPPLY_PROP_TECHNOLOGY,
+	POWER_SUPPLY_PROP_CHARGE_FULL,
+	POWER_SUPPLY_PROP_CHARGE_NOW,
+	POWER_SUPPLY_PROP_CHARGE_FULL_DESIGN,
+	POWER_SUPPLY_PROP_CYCLE_COUNT,
+	POWER_SUPPLY_PROP_HEALTH,
+	POWER_SUPPLY_PROP_MANUFACTURER,
+};
+
+static enum power_supply_property bq27500_battery_props[] = {
+	POWER_SUPPLY_PROP_STATUS,
+	POWER_SUPPLY_PROP_PRESENT,
+	POWER_SUPPLY_PROP_VOLTAGE_NOW,
+	POWER_SUPPLY_PROP_CURRENT_NOW,
+	POWER_SUPPLY_PROP_CAPACITY,
+	POWER_SUPPLY_PROP_CAPACITY_LEVEL,
+	POWER_SUPPLY_PROP_TEMP,
+	POWER_SUPPLY_PROP_TIME_TO_EMPTY_NOW,
+	POWER_SUPPLY_PROP_TECHNOLOGY,
+	POWER_SUPPLY_PROP_CHARGE_FULL,
+	POWER_SUPPLY_PROP_CHARGE_NOW,
+	POWER_SUPPLY_PROP_CHARGE_FULL_DESIGN,
+	POWER_SUPPLY_PROP_CYCLE_COUNT,
+	POWER_SUPPLY_PROP_HEALTH,
+	POWER_SUPPLY_PROP_MANUFACTURER,
+};
+
+static enum power_supply_property bq27530_battery_props[] = {
+	POWER_SUPPLY_PROP_STATUS,
+	POWER_SUPPLY_PROP_PRESENT,
+	POWER_SUPPLY_PROP_VOLTAGE_NOW,
+	POWER_SUPPLY_PROP_CURRENT_NOW,
+	POWER_SUPPLY_PROP_CAPACITY,
+	POWER_SUPPLY_PROP_CAPACITY_LEVEL,
+	POWER_SUPPLY_PROP_TEMP,
+	POWER_SUPPLY_PROP_TIME_TO_EMPTY_NOW,
+	POWER_SUPPLY_PROP_TECHNOLOGY,
+	POWER_SUPPLY_PROP_CHARGE_FULL,
+	POWER_SUPPLY_PROP_CHARGE_NOW,
+	POWER_SUPPLY_PROP_POWER_AVG,
+	POWER_SUPPLY_PROP_HEALTH,
+	POWER_SUPPLY_PROP_CYCLE_COUNT,
+	POWER_SUPPLY_PROP_MANUFACTURER,
+};
+
+static enum power_supply_property bq27541_battery_props[] = {
+	POWER_SUPPLY_PROP_STATUS,
+	POWER_SUPPLY_PROP_PRESENT,
+	POWER_SUPPLY_PROP_VOLTAGE_NOW,
+	POWER_SUPPLY_PROP_CURRENT_NOW,
+	POWER_SUPPLY_PROP_CAPACITY,
+	POWER_SUPPLY_PROP_CAPACITY_LEVEL,
+	POWER_SUPPLY_PROP_TEMP,
+	POWER_SUPPLY_PROP_TIME_TO_EMPTY_NOW,
+	POWER_SUPPLY_PROP_TECHNOLOGY,
+	POWER_SUPPLY_PROP_CHARGE_FULL,
+	POWER_SUPPLY_PROP_CHARGE_NOW,
+	POWER_SUPPLY_PROP_CHARGE_FULL_DESIGN,
+	POWER_SUPPLY_PROP_CYCLE_COUNT,
+	POWER_SUPPLY_PROP_POWER_AVG,
+	POWER_SUPPLY_PROP_HEALTH,
+	POWER_SUPPLY_PROP_MANUFACTURER,
+};
+
+static enum power_supply_property bq27545_battery_props[] = {
+	POWER_SUPPLY_PROP_STATUS,
+	POWER_SUPPLY_PROP_PRESENT,
+	POWER_SUPPLY_PROP_VOLTAGE_NOW,
+	POWER_SUPPLY_PROP_CURRENT_NOW,
+	POWER_SUPPLY_PROP_CAPACITY,
+	POWER_SUPPLY_PROP_CAPACITY_LEVEL,
+	POWER_SUPPLY_PROP_TEMP,
+	POWER_SUPPLY_PROP_TIME_TO_EMPTY_NOW,
+	POWER_SUPPLY_PROP_TECHNOLOGY,
+	POWER_SUPPLY_PROP_CHARGE_FULL,
+	POWER_SUPPLY_PROP_CHARGE_NOW,
+	POWER_SUPPLY_PROP_HEALTH,
+	POWER_SUPPLY_PROP_CYCLE_COUNT,
+	POWER_SUPPLY_PROP_POWER_AVG,
+	POWER_SUPPLY_PROP_MANUFACTURER,
+};
+
+static enum power_supply_property bq27421_battery_props[] = {
+	POWER_SUPPLY_PROP_STATUS,
+	POWER_SUPPLY_PROP_PRESENT,
+	POWER_SUPPLY_PROP_VOLTAGE_NOW,
+	POWER_SUPPLY_PROP_CURRENT_NOW,
+	POWER_SUPPLY_PROP_CAPACITY,
+	POWER_SUPPLY_PROP_CAPACITY_LEVEL,
+	POWER_SUPPLY_PROP_TEMP,
+	POWER_SUPPLY_PROP_TECHNOLOGY,
+	POWER_SUPPLY_PROP_CHARGE_FULL,
+	POWER_SUPPLY_PROP_CHARGE_NOW,
+	POWER_SUPPLY_PROP_CHARGE_FULL_DESIGN,
+	POWER_SUPPLY_PROP_MANUFACTURER,
+};
+
+#define BQ27XXX_PROP(_id, _prop)		\
+	[_id] = {				\
+		.props = _prop,			\
+		.size = ARRAY_SIZE(_prop),	\
+	}
+
+static struct {
+	enum power_supply_property *props;
+	size_t size;
+} bq27xxx_battery_props[] = {
+	BQ27XXX_PROP(BQ27000, bq27000_battery_props),
+	BQ27XXX_PROP(BQ27010, bq27010_battery_props),
+	BQ27XXX_PROP(BQ27500, bq27500_battery_props),
+	BQ27XXX_PROP(BQ27530, bq27530_battery_props),
+	BQ27XXX_PROP(BQ27541, bq27541_battery_props),
+	BQ27XXX_PROP(BQ27545, bq27545_battery_props),
+	BQ27XXX_PROP(BQ27421, bq27421_battery_props),
+};
+
+static unsigned int poll_interval = 360;
+module_param(poll_interval, uint, 0644);
+MODULE_PARM_DESC(poll_interval,
+		 "default battery poll interval in seconds for new devices - 0 disables polling");
+
+/*
+ * Routine polls run from a freezable, power-efficient workqueue with
+ * deferrable timers so an idle system is not woken just to refresh the
+ * gauge. Urgent refreshes (charger plug, low battery) go through a
+ * separate high-priority queue and run at once.
+ */
+struct workqueue_struct *bq27xxx_wq;
+struct workqueue_struct *bq27xxx_urgent_wq;
+
+/* debugfs: bq27xxx/devices/<battery>/ and bq27xxx/buses/<bus> */
+static struct dentry *bq27xxx_dfs_root;
+static struct dentry *bq27xxx_dfs_devices;
+struct dentry *bq27xxx_dfs_buses;
+
+/*
+ * Common code for BQ27xxx devices
+ */
+
+/*
+ * Return the battery State-of-Charge
+ * Or < 0 if something fails.
+ */
+static int bq27xxx_battery_read_soc(struct bq27xxx_device_info *di)
+{
+	int soc;
+
+	if (di->chip == BQ27000 || di->chip == BQ27010)
+		soc = bq27xxx_read(di, BQ27XXX_REG_SOC, true);
+	else
+		soc = bq27xxx_read(di, BQ27XXX_REG_SOC, false);
+
+	if (soc < 0)
+		dev_dbg(di->dev, "error reading State-of-Charge\n");
+
+	return soc;
+}
+
+/*
+ * Return a battery charge value in µAh
+ * Or < 0 if something fails.
+ */
+static int bq27xxx_battery_read_charge(struct bq27xxx_device_info *di, u8 reg)
+{
+	int charge;
+
+	charge = bq27xxx_read(di, reg, false);
+	if (charge < 0) {
+		dev_dbg(di->dev, "error reading charge register %02x: %d\n",
+			reg, charge);
+		return charge;
+	}
+
+	if (di->chip == BQ27000 || di->chip == BQ27010)
+		charge *= BQ27XXX_CURRENT_CONSTANT / BQ27XXX_RS;
+	else
+		charge *= 1000;
+
+	return charge;
+}
+
+/*
+ * Return the battery Full Charge Capacity in µAh
+ * Or < 0 if something fails.
+ */
+static inline int bq27xxx_battery_read_fcc(struct bq27xxx_device_info *di)
+{
+	return bq27xxx_battery_read_charge(di, BQ27XXX_REG_FCC);
+}
+
+/*
+ * Return the Design Capacity in µAh
+ * Or < 0 if something fails.
+ */
+static int bq27xxx_battery_read_dcap(struct bq27xxx_device_info *di)
+{
+	int dcap;
+
+	if (di->chip == BQ27000 || di->chip == BQ27010)
+		dcap = bq27xxx_read(di, BQ27XXX_REG_DCAP, true);
+	else
+		dcap = bq27xxx_read(di, BQ27XXX_REG_DCAP, false);
+
+	if (dcap < 0) {
+		dev_dbg(di->dev, "error reading initial last measured discharge\n");
+		return dcap;
+	}
+
+	if (di->chip == BQ27000 || di->chip == BQ27010)
+		dcap = (dcap << 8) * BQ27XXX_CURRENT_CONSTANT / BQ27XXX_RS;
+	else
+		dcap *= 1000;
+
+	return dcap;
+}
+
+/*
+ * Return the battery Available energy in µWh
+ * Or < 0 if something fails.
+ */
+static int bq27xxx_battery_read_energy(struct bq27xxx_device_info *di)
+{
+	int ae;
+
+	ae = bq27xxx_read(di, BQ27XXX_REG_AE, false);
+	if (ae < 0) {
+		dev_dbg(di->dev, "error reading available energy\n");
+		return ae;
+	}
+
+	if (di->chip == BQ27000 || di->chip == BQ27010)
+		ae *= BQ27XXX_POWER_CONSTANT / BQ27XXX_RS;
+	else
+		ae *= 1000;
+
+	return ae;
+}
+
+/*
+ * Return the battery temperature in tenths of degree Kelvin
+ * Or < 0 if something fails.
+ */
+int bq27xxx_battery_read_temperature(struct bq27xxx_device_info *di)
+{
+	int temp;
+
+	temp = bq27xxx_read(di, BQ27XXX_REG_TEMP, false);
+	if (temp < 0) {
+		dev_err(di->dev, "error reading temperature\n");
+		return temp;
+	}
+
+	if (di->chip == BQ27000 || di->chip == BQ27010)
+		temp = 5 * temp / 2;
+
+	return temp;
+}
+
+/*
+ * Return the battery Cycle count total
+ * Or < 0 if something fails.
+ */
+static int bq27xxx_battery_read_cyct(struct bq27xxx_device_info *di)
+{
+	int cyct;
+
+	cyct = bq27xxx_read(di, BQ27XXX_REG_CYCT, false);
+	if (cyct < 0)
+		dev_err(di->dev, "error reading cycle count total\n");
+
+	return cyct;
+}
+
+/*
+ * Read a time register.
+ * Return < 0 if something fails.
+ */
+static int bq27xxx_battery_read_time(struct bq27xxx_device_info *di, u8 reg)
+{
+	int tval;
+
+	tval = bq27xxx_read(di, reg, false);
+	if (tval < 0) {
+		dev_dbg(di->dev, "error reading time register %02x: %d\n",
+			reg, tval);
+		return tval;
+	}
+
+	if (tval == 65535)
+		return -ENODATA;
+
+	return tval * 60;
+}
+
+/*
+ * Read an average power register.
+ * Return < 0 if something fails.
+ */
+int bq27xxx_battery_read_pwr_avg(struct bq27xxx_device_info *di)
+{
+	int tval;
+
+	tval = bq27xxx_read(di, BQ27XXX_REG_AP, false);
+	if (tval < 0) {
+		dev_err(di->dev, "error reading average power register  %02x: %d\n",
+			BQ27XXX_REG_AP, tval);
+		return tval;
+	}
+
+	if (di->chip == BQ27000 || di->chip == BQ27010)
+		return (tval * BQ27XXX_POWER_CONSTANT) / BQ27XXX_RS;
+	else
+		return tval;
+}
+
+/*
+ * Returns true if a battery over temperature condition is detected
+ */
+static bool bq27xxx_battery_overtemp(struct bq27xxx_device_info *di, u16 flags)
+{
+	if (di->chip == BQ27500 || di->chip == BQ27541 || di->chip == BQ27545)
+		return flags & (BQ27XXX_FLAG_OTC | BQ27XXX_FLAG_OTD);
+	if (di->chip == BQ27530 || di->chip == BQ27421)
+		return flags & BQ27XXX_FLAG_OT;
+
+	return false;
+}
+
+/*
+ * Returns true if a battery under temperature condition is detected
+ */
+static bool bq27xxx_battery_undertemp(struct bq27xxx_device_info *di, u16 flags)
+{
+	if (di->chip == BQ27530 || di->chip == BQ27421)
+		return flags & BQ27XXX_FLAG_UT;
+
+	return false;
+}
+
+/*
+ * Returns true if a low state of charge condition is detected
+ */
+static bool bq27xxx_battery_dead(struct bq27xxx_device_info *di, u16 flags)
+{
+	if (di->chip == BQ27000 || di->chip == BQ27010)
+		return flags & (BQ27000_FLAG_EDV1 | BQ27000_FLAG_EDVF);
+	else
+		return flags & (BQ27XXX_FLAG_SOC1 | BQ27XXX_FLAG_SOCF);
+}
+
+/*
+ * Read flag register.
+ * Return < 0 if something fails.
+ */
+static int bq27xxx_battery_read_health(struct bq27xxx_device_info *di)
+{
+	int flags;
+
+	flags = bq27xxx_read(di, BQ27XXX_REG_FLAGS, false);
+	if (flags < 0) {
+		dev_err(di->dev, "error reading flag register:%d\n", flags);
+		return flags;
+	}
+
+	/* Unlikely but important to return first */
+	if (unlikely(bq27xxx_battery_overtemp(di, flags)))
+		return POWER_SUPPLY_HEALTH_OVERHEAT;
+	if (unlikely(bq27xxx_battery_undertemp(di, flags)))
+		return POWER_SUPPLY_HEALTH_COLD;
+	if (unlikely(bq27xxx_battery_dead(di, flags)))
+		return POWER_SUPPLY_HEALTH_DEAD;
+
+	return POWER_SUPPLY_HEALTH_GOOD;
+}
+
+/*
+ * Convert an Average Current register value to µA
+ * Note that current can be negative signed as well
+ */
+int bq27xxx_battery_current_ua(struct bq27xxx_device_info *di,
+			       int flags, int curr)
+{
+	if (di->chip == BQ27000 || di->chip == BQ27010) {
+		if (flags & BQ27000_FLAG_CHGS) {
+			dev_dbg(di->dev, "negative current!\n");
+			curr = -curr;
+		}
+
+		return curr * BQ27XXX_CURRENT_CONSTANT / BQ27XXX_RS;
+	}
+
+	/* Other gauges return signed value */
+	return (int)((s16)curr) * 1000;
+}
+
+/*
+ * Decide whether @cache differs enough from what userspace was last told
+ * about. Status, health and capacity level all derive from FLAGS, so any
+ * flag transition counts. A threshold of 0 reports every change.
+ */
+static bool bq27xxx_battery_changed(struct bq27xxx_device_info *di,
+				    const struct bq27xxx_reg_cache *cache)
+{
+	const struct bq27xxx_reg_cache *old = &di->notified;
+	unsigned int delta;
+
+	if (cache->flags != old->flags || cache->health != old->health ||
+	    cache->capacity != old->capacity)
+		return true;
+
+	delta = abs(cache->voltage - old->voltage);
+	if (delta && delta >= READ_ONCE(di->notify_voltage_mv))
+		return true;
+
+	delta = abs(cache->temperature - old->temperature);
+	if (delta && delta >= READ_ONCE(di->notify_temp_dc))
+		return true;
+
+	return false;
+}
+
+/*
+ * Send a change notification, or coalesce it with those of the last
+ * notify_interval_ms. Called with di->lock held.
+ */
+static void bq27xxx_battery_notify(struct bq27xxx_device_info *di,
+				   const struct bq27xxx_reg_cache *cache)
+{
+	unsigned int interval = READ_ONCE(di->notify_interval_ms);
+	ktime_t now = ktime_get();
+	s64 since_ms = ktime_ms_delta(now, di->notify_time);
+
+	di->notified = *cache;
+
+	if (since_ms >= interval) {
+		di->notify_time = now;
+		power_supply_changed(di->bat);
+		return;
+	}
+
+	/* A pending notification already covers this change */
+	spin_lock(&di->work_lock);
+	if (!di->removed)
+		queue_delayed_work(bq27xxx_wq, &di->notify_work,
+				   msecs_to_jiffies(interval - since_ms));
+	spin_unlock(&di->work_lock);
+}
+
+static void bq27xxx_battery_notify_work(struct work_struct *work)
+{
+	struct bq27xxx_device_info *di =
+			container_of(work, struct bq27xxx_device_info,
+				     notify_work.work);
+
+	bq27xxx_lock(di, BQ27XXX_LOCK_OTHER);
+	di->notify_time = ktime_get();
+	bq27xxx_unlock(di);
+
+	power_supply_changed(di->bat);
+}
+
+static void bq27xxx_battery_publish_page(struct bq27xxx_device_info *di,
+					 const struct bq27xxx_reg_cache *cache);
+
+static void __bq27xxx_battery_update(struct bq27xxx_device_info *di,
+				     bool notify)
+{
+	struct bq27xxx_reg_cache cache = {0, };
+	bool has_ci_flag = di->chip == BQ27000 || di->chip == BQ27010;
+	bool has_singe_flag = di->chip == BQ27000 || di->chip == BQ27010;
+	struct bq27xxx_bus_group *group;
+	ktime_t bus_start;
+	int ret;
+
+	trace_bq27xxx_update_begin(di->dev);
+
+	/* Hold the bus path up for the whole burst */
+	ret = bq27xxx_pm_get(di);
+	if (ret < 0) {
+		bq27xxx_pm_put(di);
+		dev_warn(di->dev, "Unable to resume bus, ret %d\n", ret);
+		return;
+	}
+
+	group = bq27xxx_bus_claim(di, &bus_start);
+
+	cache.flags = bq27xxx_read(di, BQ27XXX_REG_FLAGS, has_singe_flag);
+	if ((cache.flags & 0xff) == 0xff)
+		cache.flags = -1; /* read error */
+	if (cache.flags >= 0) {
+		cache.temperature = bq27xxx_battery_read_temperature(di);
+		if (has_ci_flag && (cache.flags & BQ27000_FLAG_CI)) {
+			dev_info_once(di->dev, "battery is not calibrated! ignoring capacity values\n");
+			cache.capacity = -ENODATA;
+			cache.energy = -ENODATA;
+			cache.time_to_empty = -ENODATA;
+			cache.time_to_empty_avg = -ENODATA;
+			cache.time_to_full = -ENODATA;
+			cache.charge_full = -ENODATA;
+			cache.charge_now = -ENODATA;
+			cache.health = -ENODATA;
+		} else {
+			if (di->regs[BQ27XXX_REG_TTE] != INVALID_REG_ADDR)
+				cache.time_to_empty = bq27xxx_battery_read_time(di, BQ27XXX_REG_TTE);
+			if (di->regs[BQ27XXX_REG_TTECP] != INVALID_REG_ADDR)
+				cache.time_to_empty_avg = bq27xxx_battery_read_time(di, BQ27XXX_REG_TTECP);
+			if (di->regs[BQ27XXX_REG_TTF] != INVALID_REG_ADDR)
+				cache.time_to_full = bq27xxx_battery_read_time(di, BQ27XXX_REG_TTF);
+			cache.charge_full = bq27xxx_battery_read_fcc(di);
+			cache.charge_now = bq27xxx_battery_read_charge(di, BQ27XXX_REG_NAC);
+			cache.capacity = bq27xxx_battery_read_soc(di);
+			if (di->regs[BQ27XXX_REG_AE] != INVALID_REG_ADDR)
+				cache.energy = bq27xxx_battery_read_energy(di);
+			cache.health = bq27xxx_battery_read_health(di);
+		}
+		if (di->regs[BQ27XXX_REG_CYCT] != INVALID_REG_ADDR)
+			cache.cycle_count = bq27xxx_battery_read_cyct(di);
+		if (di->regs[BQ27XXX_REG_AP] != INVALID_REG_ADDR)
+			cache.power_avg = bq27xxx_battery_read_pwr_avg(di);
+		cache.avg_current = bq27xxx_read(di, BQ27XXX_REG_AI, false);
+		if (cache.avg_current < 0)
+			dev_err(di->dev, "error reading current\n");
+		cache.voltage = bq27xxx_read(di, BQ27XXX_REG_VOLT, false);
+		if (cache.voltage < 0)
+			dev_err(di->dev, "error reading voltage\n");
+
+		/* We only have to read charge design full once */
+		if (di->charge_design_full <= 0)
+			di->charge_design_full = bq27xxx_battery_read_dcap(di);
+	}
+
+	bq27xxx_bus_release(group, bus_start);
+	bq27xxx_pm_put(di);
+
+	if (trace_bq27xxx_update_end_enabled())
+		trace_bq27xxx_update_end(di->dev, di->cache_seq + 1,
+					 bq27xxx_event_mask(&di->cache, &cache),
+					 cache.flags);
+
+	if (notify && bq27xxx_battery_changed(di, &cache)) {
+		bq27xxx_battery_queue_event(di, &di->notified, &cache);
+		bq27xxx_battery_notify(di, &cache);
+	}
+
+	/* Publish the new snapshot; readers never block on this */
+	write_seqlock(&di->cache_lock);
+	di->cache = cache;
+	di->cache_seq++;
+	di->cache_time = ktime_get();
+	di->last_update = jiffies;
+	write_sequnlock(&di->cache_lock);
+
+	bq27xxx_battery_publish_page(di, &cache);
+}
+
+void bq27xxx_battery_update(struct bq27xxx_device_info *di)
+{
+	__bq27xxx_battery_update(di, true);
+}
+EXPORT_SYMBOL_GPL(bq27xxx_battery_update);
+
+/*
+ * Account the latency from the first interrupt of a burst to the update
+ * that reported it.
+ */
+static void bq27xxx_battery_irq_latency(struct bq27xxx_device_info *di,
+					ktime_t irq_time)
+{
+	s64 latency_us = ktime_us_delta(ktime_get(), irq_time);
+
+	di->irq_latency_last_us = latency_us;
+	if (latency_us > di->irq_latency_max_us)
+		di->irq_latency_max_us = latency_us;
+}
+
+static void bq27xxx_battery_arm_poll(struct bq27xxx_device_info *di,
+				     unsigned long delay)
+{
+	spin_lock(&di->work_lock);
+	if (!di->removed && !di->suspended) {
+		di->next_poll = jiffies + delay;
+		mod_delayed_work(bq27xxx_wq, &di->work, delay);
+	}
+	spin_unlock(&di->work_lock);
+}
+
+/*
+ * Re-arm the poll work one interval from now, or leave it idle if polling
+ * is disabled for this device or the device is going away. Works are only
+ * armed under di->work_lock, after checking removed and suspended, so the
+ * cancels in teardown and suspend cannot be raced.
+ */
+static void bq27xxx_battery_schedule_poll(struct bq27xxx_device_info *di)
+{
+	unsigned int interval = READ_ONCE(di->poll_interval);
+	unsigned long delay;
+
+	if (interval == 0)
+		return;
+
+	if (READ_ONCE(di->pm_mode) == BQ27XXX_PM_HIBERNATE)
+		interval = max(interval, READ_ONCE(di->hibernate_poll_interval));
+
+	/* Keep to our bus slot, but never poll twice in half an interval */
+	delay = bq27xxx_bus_slot_delay(di, interval,
+				       (u64)interval * NSEC_PER_SEC / 2);
+	if (!delay)
+		delay = interval * HZ;
+
+	bq27xxx_battery_arm_poll(di, delay);
+}
+
+/*
+ * Arm the first poll about @delay_s seconds after probe, in this gauge's
+ * bus slot so that gauges probed together do not poll together.
+ */
+void bq27xxx_battery_start_polling(struct bq27xxx_device_info *di,
+				   unsigned int delay_s)
+{
+	unsigned int interval = READ_ONCE(di->poll_interval);
+	unsigned long delay = 0;
+
+	if (interval)
+		delay = bq27xxx_bus_slot_delay(di, interval,
+					       (u64)delay_s * NSEC_PER_SEC);
+	if (!delay)
+		delay = delay_s * HZ;
+
+	di->next_poll = jiffies + delay;
+	queue_delayed_work(bq27xxx_wq, &di->work, delay);
+}
+EXPORT_SYMBOL_GPL(bq27xxx_battery_start_polling);
+
+/*
+ * Let the gauge's power-mode manager act on the fresh snapshot. Only the
+ * poll work and the resume resync call this, never concurrently, and
+ * without di->lock: mode changes run as maintenance operations.
+ */
+static void bq27xxx_battery_power_mode(struct bq27xxx_device_info *di)
+{
+	bool wake = atomic_xchg(&di->pm_wake, 0);
+	int flags, avg_current;
+	unsigned int seq;
+
+	do {
+		seq = read_seqbegin(&di->cache_lock);
+		flags = di->cache.flags;
+		avg_current = di->cache.avg_current;
+	} while (read_seqretry(&di->cache_lock, seq));
+
+	if (flags < 0 || avg_current < 0)
+		return;
+
+	bq27441_update_power_mode(di,
+			bq27xxx_battery_current_ua(di, flags, avg_current),
+			wake);
+}
+
+/*
+ * Consume the pending interrupt burst, if any, before an update.
+ * Interrupts from here on need another update.
+ */
+static bool bq27xxx_battery_take_irq(struct bq27xxx_device_info *di,
+				     ktime_t *irq_time)
+{
+	bool irq_seen;
+
+	spin_lock(&di->irq_lock);
+	irq_seen = di->irq_pending;
+	*irq_time = di->irq_time;
+	di->irq_pending = false;
+	spin_unlock(&di->irq_lock);
+
+	return irq_seen;
+}
+
+static void bq27xxx_battery_do_poll(struct bq27xxx_device_info *di,
+				    bool periodic)
+{
+	ktime_t irq_time;
+	bool irq_seen;
+
+	irq_seen = bq27xxx_battery_take_irq(di, &irq_time);
+
+	bq27xxx_lock(di, BQ27XXX_LOCK_UPDATE);
+	bq27xxx_battery_update(di);
+	bq27xxx_unlock(di);
+
+	if (periodic)
+		bq27xxx_battery_power_mode(di);
+
+	atomic_set(&di->refresh_pending, 0);
+	wake_up_all(&di->refresh_wait);
+
+	if (irq_seen)
+		bq27xxx_battery_irq_latency(di, irq_time);
+
+	bq27xxx_battery_schedule_poll(di);
+	bq27xxx_bus_batch(di);
+}
+
+static void bq27xxx_battery_poll(struct work_struct *work)
+{
+	struct bq27xxx_device_info *di =
+			container_of(work, struct bq27xxx_device_info,
+				     work.work);
+
+	bq27xxx_battery_do_poll(di, true);
+}
+
+static void bq27xxx_battery_urgent_poll(struct work_struct *work)
+{
+	struct bq27xxx_device_info *di =
+			container_of(work, struct bq27xxx_device_info,
+				     urgent_work);
+
+	bq27xxx_battery_do_poll(di, false);
+}
+
+/*
+ * Refresh right away from the high-priority queue. Returns false if the
+ * device is going away or suspended.
+ */
+static bool bq27xxx_battery_poll_urgent(struct bq27xxx_device_info *di)
+{
+	bool armed;
+
+	spin_lock(&di->work_lock);
+	armed = !di->removed && !di->suspended;
+	if (armed)
+		queue_work(bq27xxx_urgent_wq, &di->urgent_work);
+	spin_unlock(&di->work_lock);
+
+	return armed;
+}
+
+/*
+ * Returns true if the flag transition from @old to @new needs reporting
+ * right away: charge state, low battery or temperature alarms.
+ */
+static bool bq27xxx_battery_urgent(struct bq27xxx_device_info *di,
+				   int old, int new)
+{
+	u16 mask;
+
+	if (old < 0 || new < 0)
+		return old != new;
+
+	if (di->chip == BQ27000 || di->chip == BQ27010)
+		mask = BQ27000_FLAG_FC | BQ27000_FLAG_CHGS |
+		       BQ27000_FLAG_EDV1 | BQ27000_FLAG_EDVF;
+	else
+		mask = BQ27XXX_FLAG_FC | BQ27XXX_FLAG_DSC |
+		       BQ27XXX_FLAG_SOC1 | BQ27XXX_FLAG_SOCF |
+		       BQ27XXX_FLAG_OT | BQ27XXX_FLAG_UT;
+
+	return (old ^ new) & mask;
+}
+
+/*
+ * Called from the threaded IRQ handler. Only FLAGS is read here; the full
+ * snapshot is left to the poll work so that a burst of interrupts is
+ * coalesced into one update. Flag edges that matter to userspace skip the
+ * debounce window.
+ */
+void bq27xxx_battery_irq(struct bq27xxx_device_info *di)
+{
+	bool single = di->chip == BQ27000 || di->chip == BQ27010;
+	unsigned long delay = msecs_to_jiffies(BQ27XXX_IRQ_DEBOUNCE_MS);
+	unsigned int count;
+	bool armed;
+	int flags;
+
+	spin_lock(&di->irq_lock);
+	armed = di->irq_pending;
+	if (!armed) {
+		di->irq_pending = true;
+		di->irq_time = ktime_get();
+	}
+	count = ++di->irq_count;
+	spin_unlock(&di->irq_lock);
+
+	trace_bq27xxx_irq(di->dev, count, armed);
+
+	/* The bus may be down; the resume burst picks this one up */
+	if (READ_ONCE(di->suspended))
+		return;
+
+	/*
+	 * Leave the bus alone while a config session or an update holds
+	 * di->lock; the debounced update reads FLAGS anyway.
+	 */
+	if (bq27xxx_trylock(di, BQ27XXX_LOCK_IRQ)) {
+		flags = bq27xxx_read(di, BQ27XXX_REG_FLAGS, single);
+		bq27xxx_unlock(di);
+		if (flags >= 0 &&
+		    bq27xxx_battery_urgent(di, READ_ONCE(di->cache.flags), flags))
+			delay = 0;
+	} else {
+		bq27xxx_lock_skipped(di, BQ27XXX_LOCK_IRQ);
+	}
+
+	/*
+	 * Let a hibernating gauge's power mode be re-evaluated right away;
+	 * only the poll work does that.
+	 */
+	if (READ_ONCE(di->pm_mode) == BQ27XXX_PM_HIBERNATE) {
+		bq27xxx_battery_arm_poll(di, 0);
+		return;
+	}
+
+	if (!delay) {
+		bq27xxx_battery_poll_urgent(di);
+		return;
+	}
+
+	/* An update is already on its way */
+	if (armed)
+		return;
+
+	spin_lock(&di->work_lock);
+	if (!di->removed && !di->suspended)
+		mod_delayed_work(bq27xxx_wq, &di->work, delay);
+	spin_unlock(&di->work_lock);
+}
+EXPORT_SYMBOL_GPL(bq27xxx_battery_irq);
+
+/*
+ * Take a consistent copy of the cached snapshot without taking di->lock.
+ * Returns the sequence number of the copy, and its monotonic timestamp
+ * in @stamp if not NULL.
+ */
+static u64 bq27xxx_battery_snapshot(struct bq27xxx_device_info *di,
+				    struct bq27xxx_reg_cache *cache,
+				    ktime_t *stamp)
+{
+	unsigned int seq;
+	u64 cache_seq;
+
+	do {
+		seq = read_seqbegin(&di->cache_lock);
+		*cache = di->cache;
+		cache_seq = di->cache_seq;
+		if (stamp)
+			*stamp = di->cache_time;
+	} while (read_seqretry(&di->cache_lock, seq));
+
+	return cache_seq;
+}
+
+/*
+ * Property reads kick a refresh once the snapshot is older than this,
+ * whatever the poll interval. A hibernating gauge is left alone; its
+ * snapshot ages up to the hibernate poll interval.
+ */
+static inline bool bq27xxx_battery_stale(struct bq27xxx_device_info *di)
+{
+	return time_is_before_jiffies(di->last_update + 5 * HZ);
+}
+
+/*
+ * Kick a refresh of a stale cache from the high-priority queue; readers
+ * never touch the bus themselves. Kicks are coalesced until the refresh
+ * lands. Returns true if a refresh is on its way.
+ */
+static bool bq27xxx_battery_kick(struct bq27xxx_device_info *di)
+{
+	if (!bq27xxx_battery_stale(di) ||
+	    READ_ONCE(di->pm_mode) == BQ27XXX_PM_HIBERNATE)
+		return false;
+
+	/*
+	 * A maintenance operation (config session, factory reset, ...) owns
+	 * the bus; serve the last snapshot rather than queue behind it.
+	 * Its age is visible through the snapshot_age_ms attribute.
+	 */
+	if (atomic_read(&di->maint_active)) {
+		bq27xxx_lock_skipped(di, BQ27XXX_LOCK_PROPERTY);
+		return false;
+	}
+
+	if (atomic_cmpxchg(&di->refresh_pending, 0, 1))
+		return true;
+
+	if (!bq27xxx_battery_poll_urgent(di)) {
+		atomic_set(&di->refresh_pending, 0);
+		return false;
+	}
+
+	return true;
+}
+
+/*
+ * Wait a bounded time for a stale cache to be refreshed. Gives up early
+ * on a signal or as soon as a maintenance operation takes the bus, so a
+ * reader never ends up queued behind one.
+ */
+static void bq27xxx_battery_refresh(struct bq27xxx_device_info *di)
+{
+	if (!bq27xxx_battery_kick(di))
+		return;
+
+	wait_event_interruptible_timeout(di->refresh_wait,
+			!atomic_read(&di->refresh_pending) ||
+			atomic_read(&di->maint_active),
+			msecs_to_jiffies(BQ27XXX_REFRESH_TIMEOUT_MS));
+}
+
+/*
+ * Return the battery average current in µA from the cache, which property
+ * reads keep within 5 s, rather than from a register read of its own.
+ * Or < 0 if it could not be read.
+ */
+static int bq27xxx_battery_current(struct bq27xxx_device_info *di,
+				   const struct bq27xxx_reg_cache *cache,
+				   union power_supply_propval *val)
+{
+	if (cache->avg_current < 0)
+		return cache->avg_current;
+
+	val->intval = bq27xxx_battery_current_ua(di, cache->flags,
+						 cache->avg_current);
+
+	return 0;
+}
+
+static int bq27xxx_battery_status(struct bq27xxx_device_info *di,
+				  const struct bq27xxx_reg_cache *cache,
+				  union power_supply_propval *val)
+{
+	int status;
+
+	if (di->chip == BQ27000 || di->chip == BQ27010) {
+		if (cache->flags & BQ27000_FLAG_FC)
+			status = POWER_SUPPLY_STATUS_FULL;
+		else if (cache->flags & BQ27000_FLAG_CHGS)
+			status = POWER_SUPPLY_STATUS_CHARGING;
+		else if (power_supply_am_i_supplied(di->bat))
+			status = POWER_SUPPLY_STATUS_NOT_CHARGING;
+		else
+			status = POWER_SUPPLY_STATUS_DISCHARGING;
+	} else {
+		if (cache->flags & BQ27XXX_FLAG_FC)
+			status = POWER_SUPPLY_STATUS_FULL;
+		else if (cache->flags & BQ27XXX_FLAG_DSC)
+			status = POWER_SUPPLY_STATUS_DISCHARGING;
+		else
+			status = POWER_SUPPLY_STATUS_CHARGING;
+	}
+
+	val->intval = status;
+
+	return 0;
+}
+
+static int bq27xxx_battery_capacity_level(struct bq27xxx_device_info *di,
+					  const struct bq27xxx_reg_cache *cache,
+					  union power_supply_propval *val)
+{
+	int level;
+
+	if (di->chip == BQ27000 || di->chip == BQ27010) {
+		if (cache->flags & BQ27000_FLAG_FC)
+			level = POWER_SUPPLY_CAPACITY_LEVEL_FULL;
+		else if (cache->flags & BQ27000_FLAG_EDV1)
+			level = POWER_SUPPLY_CAPACITY_LEVEL_LOW;
+		else if (cache->flags & BQ27000_FLAG_EDVF)
+			level = POWER_SUPPLY_CAPACITY_LEVEL_CRITICAL;
+		else
+			level = POWER_SUPPLY_CAPACITY_LEVEL_NORMAL;
+	} else {
+		if (cache->flags & BQ27XXX_FLAG_FC)
+			level = POWER_SUPPLY_CAPACITY_LEVEL_FULL;
+		else if (cache->flags & BQ27XXX_FLAG_SOC1)
+			level = POWER_SUPPLY_CAPACITY_LEVEL_LOW;
+		else if (cache->flags & BQ27XXX_FLAG_SOCF)
+			level = POWER_SUPPLY_CAPACITY_LEVEL_CRITICAL;
+		else
+			level = POWER_SUPPLY_CAPACITY_LEVEL_NORMAL;
+	}
+
+	val->intval = level;
+
+	return 0;
+}
+
+/*
+ * Return the battery Voltage in millivolts
+ * Or < 0 if something fails.
+ */
+static int bq27xxx_battery_voltage(struct bq27xxx_device_info *di,
+				   const struct bq27xxx_reg_cache *cache,
+				   union power_supply_propval *val)
+{
+	if (cache->voltage < 0)
+		return cache->voltage;
+
+	val->intval = cache->voltage * 1000;
+
+	return 0;
+}
+
+static int bq27xxx_simple_value(int value,
+				union power_supply_propval *val)
+{
+	if (value < 0)
+		return value;
+
+	val->intval = value;
+
+	return 0;
+}
+
+static int bq27xxx_battery_get_property(struct power_supply *psy,
+					enum power_supply_property psp,
+					union power_supply_propval *val)
+{
+	int ret = 0;
+	struct bq27xxx_device_info *di = power_supply_get_drvdata(psy);
+	struct bq27xxx_reg_cache cache;
+
+	bq27xxx_battery_kick(di);
+	bq27xxx_battery_snapshot(di, &cache, NULL);
+
+	if (psp != POWER_SUPPLY_PROP_PRESENT && cache.flags < 0)
+		return -ENODEV;
+
+	switch (psp) {
+	case POWER_SUPPLY_PROP_STATUS:
+		ret = bq27xxx_battery_status(di, &cache, val);
+		break;
+	case POWER_SUPPLY_PROP_VOLTAGE_NOW:
+		ret = bq27xxx_battery_voltage(di, &cache, val);
+		break;
+	case POWER_SUPPLY_PROP_PRESENT:
+		val->intval = cache.flags < 0 ? 0 : 1;
+		break;
+	case POWER_SUPPLY_PROP_CURRENT_NOW:
+		ret = bq27xxx_battery_current(di, &cache, val);
+		break;
+	case POWER_SUPPLY_PROP_CAPACITY:
+		ret = bq27xxx_simple_value(cache.capacity, val);
+		break;
+	case POWER_SUPPLY_PROP_CAPACITY_LEVEL:
+		ret = bq27xxx_battery_capacity_level(di, &cache, val);
+		break;
+	case POWER_SUPPLY_PROP_TEMP:
+		ret = bq27xxx_simple_value(cache.temperature, val);
+		if (ret == 0)
+			val->intval -= 2731; /* convert decidegree k to c */
+		break;
+	case POWER_SUPPLY_PROP_TIME_TO_EMPTY_NOW:
+		ret = bq27xxx_simple_value(cache.time_to_empty, val);
+		break;
+	case POWER_SUPPLY_PROP_TIME_TO_EMPTY_AVG:
+		ret = bq27xxx_simple_value(cache.time_to_empty_avg, val);
+		break;
+	case POWER_SUPPLY_PROP_TIME_TO_FULL_NOW:
+		ret = bq27xxx_simple_value(cache.time_to_full, val);
+		break;
+	case POWER_SUPPLY_PROP_TECHNOLOGY:
+		val->intval = POWER_SUPPLY_TECHNOLOGY_LION;
+		break;
+	case POWER_SUPPLY_PROP_CHARGE_NOW:
+		ret = bq27xxx_simple_value(cache.charge_now, val);
+		break;
+	case POWER_SUPPLY_PROP_CHARGE_FULL:
+		ret = bq27xxx_simple_value(cache.charge_full, val);
+		break;
+	case POWER_SUPPLY_PROP_CHARGE_FULL_DESIGN:
+		ret = bq27xxx_simple_value(di->charge_design_full, val);
+		break;
+	case POWER_SUPPLY_PROP_CYCLE_COUNT:
+		ret = bq27xxx_simple_value(cache.cycle_count, val);
+		break;
+	case POWER_SUPPLY_PROP_ENERGY_NOW:
+		ret = bq27xxx_simple_value(cache.energy, val);
+		break;
+	case POWER_SUPPLY_PROP_POWER_AVG:
+		ret = bq27xxx_simple_value(cache.power_avg, val);
+		break;
+	case POWER_SUPPLY_PROP_HEALTH:
+		ret = bq27xxx_simple_value(cache.health, val);
+		break;
+	case POWER_SUPPLY_PROP_MANUFACTURER:
+		val->strval = BQ27XXX_MANUFACTURER;
+		break;
+	default:
+		return -EINVAL;
+	}
+
+	return ret;
+}
+
+static void bq27xxx_battery_fill_snapshot(struct bq27xxx_device_info *di,
+					  const struct bq27xxx_reg_cache *cache,
+					  u64 seq, ktime_t stamp,
+					  struct bq27xxx_snapshot *snap)
+{
+	union power_supply_propval val;
+	int ret;
+
+	memset(snap, 0, sizeof(*snap));
+	snap->version = BQ27XXX_SNAPSHOT_VERSION;
+	snap->size = sizeof(*snap);
+	snap->seq = seq;
+	snap->timestamp_ns = ktime_to_ns(stamp);
+
+	snap->flags = cache->flags;
+	ret = bq27xxx_battery_status(di, cache, &val);
+	snap->status = ret ? ret : val.intval;
+	snap->health = cache->health;
+	snap->capacity = cache->capacity;
+	snap->voltage_uv = cache->voltage < 0 ? cache->voltage :
+						cache->voltage * 1000;
+	ret = bq27xxx_battery_current(di, cache, &val);
+	snap->current_ua = ret ? ret : val.intval;
+	snap->temp = cache->temperature < 0 ? cache->temperature :
+					      cache->temperature - 2731;
+	snap->charge_now_uah = cache->charge_now;
+	snap->charge_full_uah = cache->charge_full;
+	snap->charge_full_design_uah = di->charge_design_full;
+	snap->energy_uwh = cache->energy;
+	snap->power_avg_uw = cache->power_avg;
+	snap->time_to_empty_s = cache->time_to_empty;
+	snap->time_to_empty_avg_s = cache->time_to_empty_avg;
+	snap->time_to_full_s = cache->time_to_full;
+	snap->cycle_count = cache->cycle_count;
+}
+
+/*
+ * Mirror a freshly published snapshot into the mmap()able page. Writers
+ * are serialised by di->lock, which every update holds, the first one in
+ * setup included; two writers at once could leave seq odd for good.
+ * Readers follow the protocol documented in bq27xxx_snapshot.h.
+ */
+static void bq27xxx_battery_publish_page(struct bq27xxx_device_info *di,
+					 const struct bq27xxx_reg_cache *cache)
+{
+	struct bq27xxx_snapshot_page *page;
+	struct bq27xxx_snapshot snap;
+	u32 seq;
+
+	lockdep_assert_held(&di->lock);
+
+	if (!di->snap_page)
+		return;
+
+	bq27xxx_battery_fill_snapshot(di, cache, di->cache_seq,
+				      di->cache_time, &snap);
+
+	page = page_address(di->snap_page);
+	seq = page->seq;
+
+	WRITE_ONCE(page->seq, seq + 1);
+	smp_wmb();
+	page->snap = snap;
+	smp_wmb();
+	WRITE_ONCE(page->seq, seq + 2);
+}
+
+/*
+ * The whole snapshot in one read, laid out as struct bq27xxx_snapshot.
+ * Unlike a property read, waits briefly for a stale cache to refresh.
+ */
+static ssize_t snapshot_read(struct file *filp, struct kobject *kobj,
+			     struct bin_attribute *attr, char *buf,
+			     loff_t off, size_t count)
+{
+	struct bq27xxx_device_info *di = dev_get_drvdata(kobj_to_dev(kobj));
+	struct bq27xxx_snapshot snap;
+	struct bq27xxx_reg_cache cache;
+	ktime_t stamp;
+	u64 seq;
+
+	bq27xxx_battery_refresh(di);
+	seq = bq27xxx_battery_snapshot(di, &cache, &stamp);
+	bq27xxx_battery_fill_snapshot(di, &cache, seq, stamp, &snap);
+
+	return memory_read_from_buffer(buf, count, &off, &snap, sizeof(snap));
+}
+static BIN_ATTR_RO(snapshot, sizeof(struct bq27xxx_snapshot));
+
+/*
+ * Map the snapshot page read-only. Polling does not refresh this page on
+ * demand; it is as fresh as the last poll or property read.
+ */
+static int snapshot_page_mmap(struct file *filp, struct kobject *kobj,
+			      struct bin_attribute *attr,
+			      struct vm_area_struct *vma)
+{
+	struct bq27xxx_device_info *di = dev_get_drvdata(kobj_to_dev(kobj));
+
+	if (!di->snap_page)
+		return -ENODEV;
+
+	if (vma->vm_pgoff || vma->vm_end - vma->vm_start != PAGE_SIZE)
+		return -EINVAL;
+
+	if (vma->vm_flags & VM_WRITE)
+		return -EPERM;
+	vma->vm_flags &= ~VM_MAYWRITE;
+
+	return vm_insert_page(vma, vma->vm_start, di->snap_page);
+}
+
+static ssize_t snapshot_page_read(struct file *filp, struct kobject *kobj,
+				  struct bin_attribute *attr, char *buf,
+				  loff_t off, size_t count)
+{
+	struct bq27xxx_device_info *di = dev_get_drvdata(kobj_to_dev(kobj));
+	const struct bq27xxx_snapshot_page *page;
+	struct bq27xxx_snapshot_page copy = { 0 };
+	u32 seq;
+
+	if (!di->snap_page)
+		return -ENODEV;
+
+	if (off >= PAGE_SIZE)
+		return 0;
+	count = min_t(size_t, count, PAGE_SIZE - off);
+
+	/* Same protocol as mappers; the writer never sleeps mid-update */
+	page = page_address(di->snap_page);
+	for (;;) {
+		seq = READ_ONCE(page->seq);
+		if (seq & 1) {
+			cpu_relax();
+			continue;
+		}
+		smp_rmb();
+		copy.snap = page->snap;
+		smp_rmb();
+		if (READ_ONCE(page->seq) == seq)
+			break;
+	}
+	copy.seq = seq;
+
+	/* The rest of the page is zero */
+	memset(buf, 0, count);
+	if (off < sizeof(copy))
+		memcpy(buf, (u8 *)&copy + off,
+		       min_t(size_t, count, sizeof(copy) - off));
+
+	return count;
+}
+
+static struct bin_attribute bin_attr_snapshot_page = {
+	.attr = { .name = "snapshot_page", .mode = 0444 },
+	.size = PAGE_SIZE,
+	.read = snapshot_page_read,
+	.mmap = snapshot_page_mmap,
+};
+
+static ssize_t snapshot_age_ms_show(struct device *dev,
+				    struct device_attribute *attr, char *buf)
+{
+	struct bq27xxx_device_info *di = dev_get_drvdata(dev);
+	struct bq27xxx_reg_cache cache;
+	ktime_t stamp;
+
+	/* Nothing to age before the first update lands */
+	if (!bq27xxx_battery_snapshot(di, &cache, &stamp))
+		return -ENODATA;
+
+	return sprintf(buf, "%lld\n", ktime_ms_delta(ktime_get(), stamp));
+}
+static DEVICE_ATTR_RO(snapshot_age_ms);
+
+static ssize_t snapshot_seq_show(struct device *dev,
+				 struct device_attribute *attr, char *buf)
+{
+	struct bq27xxx_device_info *di = dev_get_drvdata(dev);
+	struct bq27xxx_reg_cache cache;
+
+	return sprintf(buf, "%llu\n",
+		       bq27xxx_battery_snapshot(di, &cache, NULL));
+}
+static DEVICE_ATTR_RO(snapshot_seq);
+
+static ssize_t gauge_busy_show(struct device *dev,
+			       struct device_attribute *attr, char *buf)
+{
+	struct bq27xxx_device_info *di = dev_get_drvdata(dev);
+
+	return sprintf(buf, "%d\n", atomic_read(&di->maint_active) ? 1 : 0);
+}
+static DEVICE_ATTR_RO(gauge_busy);
+
+static ssize_t irq_count_show(struct device *dev,
+			      struct device_attribute *attr, char *buf)
+{
+	struct bq27xxx_device_info *di = dev_get_drvdata(dev);
+
+	return sprintf(buf, "%u\n", di->irq_count);
+}
+static DEVICE_ATTR_RO(irq_count);
+
+static ssize_t irq_latency_last_us_show(struct device *dev,
+					struct device_attribute *attr,
+					char *buf)
+{
+	struct bq27xxx_device_info *di = dev_get_drvdata(dev);
+
+	return sprintf(buf, "%lld\n", di->irq_latency_last_us);
+}
+static DEVICE_ATTR_RO(irq_latency_last_us);
+
+static ssize_t irq_latency_max_us_show(struct device *dev,
+				       struct device_attribute *attr,
+				       char *buf)
+{
+	struct bq27xxx_device_info *di = dev_get_drvdata(dev);
+
+	return sprintf(buf, "%lld\n", di->irq_latency_max_us);
+}
+static DEVICE_ATTR_RO(irq_latency_max_us);
+
+static ssize_t resume_latency_us_show(struct device *dev,
+				      struct device_attribute *attr, char *buf)
+{
+	struct bq27xxx_device_info *di = dev_get_drvdata(dev);
+
+	return sprintf(buf, "%lld\n", di->resume_latency_us);
+}
+static DEVICE_ATTR_RO(resume_latency_us);
+
+static ssize_t resume_latency_max_us_show(struct device *dev,
+					  struct device_attribute *attr,
+					  char *buf)
+{
+	struct bq27xxx_device_info *di = dev_get_drvdata(dev);
+
+	return sprintf(buf, "%lld\n", di->resume_latency_max_us);
+}
+static DEVICE_ATTR_RO(resume_latency_max_us);
+
+static ssize_t last_suspend_ms_show(struct device *dev,
+				    struct device_attribute *attr, char *buf)
+{
+	struct bq27xxx_device_info *di = dev_get_drvdata(dev);
+
+	return sprintf(buf, "%lld\n", di->last_suspend_ms);
+}
+static DEVICE_ATTR_RO(last_suspend_ms);
+
+static s64 bq27xxx_battery_rpm_active_us(struct bq27xxx_device_info *di,
+					 ktime_t now)
+{
+	unsigned long flags;
+	s64 active_us;
+
+	spin_lock_irqsave(&di->rpm_lock, flags);
+	active_us = di->rpm_active_us;
+	if (di->rpm_active)
+		active_us += ktime_us_delta(now, di->rpm_since);
+	spin_unlock_irqrestore(&di->rpm_lock, flags);
+
+	return active_us;
+}
+
+static ssize_t runtime_active_ms_show(struct device *dev,
+				      struct device_attribute *attr, char *buf)
+{
+	struct bq27xxx_device_info *di = dev_get_drvdata(dev);
+	s64 active_us = bq27xxx_battery_rpm_active_us(di, ktime_get());
+
+	return sprintf(buf, "%lld\n", div_s64(active_us, USEC_PER_MSEC));
+}
+static DEVICE_ATTR_RO(runtime_active_ms);
+
+/* Average runtime-active milliseconds per hour since probe */
+static ssize_t runtime_active_per_hour_ms_show(struct device *dev,
+					       struct device_attribute *attr,
+					       char *buf)
+{
+	struct bq27xxx_device_info *di = dev_get_drvdata(dev);
+	ktime_t now = ktime_get();
+	s64 active_us = bq27xxx_battery_rpm_active_us(di, now);
+	s64 elapsed_ms = ktime_ms_delta(now, di->rpm_epoch);
+
+	if (elapsed_ms <= 0)
+		return sprintf(buf, "0\n");
+
+	return sprintf(buf, "%lld\n", div64_s64(active_us * 3600, elapsed_ms));
+}
+static DEVICE_ATTR_RO(runtime_active_per_hour_ms);
+
+static ssize_t runtime_resumes_show(struct device *dev,
+				    struct device_attribute *attr, char *buf)
+{
+	struct bq27xxx_device_info *di = dev_get_drvdata(dev);
+
+	return sprintf(buf, "%u\n", READ_ONCE(di->rpm_resumes));
+}
+static DEVICE_ATTR_RO(runtime_resumes);
+
+#define BQ27XXX_NOTIFY_ATTR(_name)					\
+static ssize_t _name##_show(struct device *dev,				\
+			    struct device_attribute *attr, char *buf)	\
+{									\
+	struct bq27xxx_device_info *di = dev_get_drvdata(dev);		\
+									\
+	return sprintf(buf, "%u\n", READ_ONCE(di->_name));		\
+}									\
+									\
+static ssize_t _name##_store(struct device *dev,			\
+			     struct device_attribute *attr,		\
+			     const char *buf, size_t count)		\
+{									\
+	struct bq27xxx_device_info *di = dev_get_drvdata(dev);		\
+	unsigned int value;						\
+	int ret;							\
+									\
+	ret = kstrtouint(buf, 0, &value);				\
+	if (ret)							\
+		return ret;						\
+									\
+	WRITE_ONCE(di->_name, value);					\
+									\
+	return count;							\
+}									\
+static DEVICE_ATTR_RW(_name)
+
+BQ27XXX_NOTIFY_ATTR(notify_voltage_mv);
+BQ27XXX_NOTIFY_ATTR(notify_temp_dc);
+BQ27XXX_NOTIFY_ATTR(notify_interval_ms);
+
+static ssize_t poll_interval_show(struct device *dev,
+				  struct device_attribute *attr, char *buf)
+{
+	struct bq27xxx_device_info *di = dev_get_drvdata(dev);
+
+	return sprintf(buf, "%u\n", READ_ONCE(di->poll_interval));
+}
+
+static ssize_t poll_interval_store(struct device *dev,
+				   struct device_attribute *attr,
+				   const char *buf, size_t count)
+{
+	struct bq27xxx_device_info *di = dev_get_drvdata(dev);
+	unsigned int interval;
+	int ret;
+
+	ret = kstrtouint(buf, 0, &interval);
+	if (ret)
+		return ret;
+
+	WRITE_ONCE(di->poll_interval, interval);
+
+	if (interval == 0)
+		cancel_delayed_work_sync(&di->work);
+	else
+		bq27xxx_battery_schedule_poll(di);
+
+	return count;
+}
+static DEVICE_ATTR_RW(poll_interval);
+
+static struct attribute *bq27xxx_battery_attrs[] = {
+	&dev_attr_poll_interval.attr,
+	&dev_attr_snapshot_age_ms.attr,
+	&dev_attr_snapshot_seq.attr,
+	&dev_attr_gauge_busy.attr,
+	&dev_attr_irq_count.attr,
+	&dev_attr_irq_latency_last_us.attr,
+	&dev_attr_irq_latency_max_us.attr,
+	&dev_attr_resume_latency_us.attr,
+	&dev_attr_resume_latency_max_us.attr,
+	&dev_attr_last_suspend_ms.attr,
+	&dev_attr_runtime_active_ms.attr,
+	&dev_attr_runtime_active_per_hour_ms.attr,
+	&dev_attr_runtime_resumes.attr,
+	&dev_attr_notify_voltage_mv.attr,
+	&dev_attr_notify_temp_dc.attr,
+	&dev_attr_notify_interval_ms.attr,
+	NULL,
+};
+
+static struct bin_attribute *bq27xxx_battery_bin_attrs[] = {
+	&bin_attr_snapshot,
+	&bin_attr_snapshot_page,
+	NULL,
+};
+
+static const struct attribute_group bq27xxx_battery_attr_group = {
+	.attrs = bq27xxx_battery_attrs,
+	.bin_attrs = bq27xxx_battery_bin_attrs,
+};
+
+static void bq27xxx_external_power_changed(struct power_supply *psy)
+{
+	struct bq27xxx_device_info *di = power_supply_get_drvdata(psy);
+
+	/* A charger event takes the gauge out of hibernate */
+	atomic_set(&di->pm_wake, 1);
+	if (READ_ONCE(di->pm_mode) == BQ27XXX_PM_HIBERNATE)
+		bq27xxx_battery_arm_poll(di, 0);
+	else
+		bq27xxx_battery_poll_urgent(di);
+}
+
+int bq27xxx_battery_setup(struct bq27xxx_device_info *di)
+{
+	struct power_supply_desc *psy_desc;
+	struct power_supply_config psy_cfg = { .drv_data = di, };
+	int volt, ret;
+
+	di->probe.start = ktime_get();
+	di->probe.mark = di->probe.start;
+	di->probe.mark_bus_ns = atomic64_read(&di->bus_ns);
+	di->probe.mark_bus_ops = atomic_read(&di->bus_ops);
+
+	INIT_DEFERRABLE_WORK(&di->work, bq27xxx_battery_poll);
+	INIT_WORK(&di->urgent_work, bq27xxx_battery_urgent_poll);
+	INIT_DELAYED_WORK(&di->notify_work, bq27xxx_battery_notify_work);
+	mutex_init(&di->lock);
+	spin_lock_init(&di->lock_stats_lock);
+	spin_lock_init(&di->work_lock);
+	init_waitqueue_head(&di->refresh_wait);
+	atomic_set(&di->refresh_pending, 0);
+	seqlock_init(&di->cache_lock);
+	atomic_set(&di->maint_active, 0);
+	spin_lock_init(&di->irq_lock);
+	atomic_set(&di->pm_wake, 0);
+	di->pm_mode = BQ27XXX_PM_NORMAL;
+	di->pm_mode_since = ktime_get();
+	spin_lock_init(&di->rpm_lock);
+	di->rpm_active = true;
+	di->rpm_since = ktime_get();
+	di->rpm_epoch = di->rpm_since;
+	di->regs = bq27xxx_regs[di->chip];
+	di->poll_interval = poll_interval;
+	di->notify_voltage_mv = BQ27XXX_NOTIFY_VOLTAGE_MV;
+	di->notify_temp_dc = BQ27XXX_NOTIFY_TEMP_DC;
+	di->notify_interval_ms = BQ27XXX_NOTIFY_INTERVAL_MS;
+	di->notify_time = ktime_get();
+
+	di->dfs_dev_dir = debugfs_create_dir(di->name, bq27xxx_dfs_devices);
+	bq27xxx_bus_stats_create(di);
+	bq27xxx_bus_trace_create(di);
+	bq27xxx_dev_debugfs_create(di);
+
+	/* Zeroed, so mappers see seq 0 until the first burst lands */
+	di->snap_page = alloc_page(GFP_KERNEL | __GFP_ZERO);
+	if (!di->snap_page) {
+		ret = -ENOMEM;
+		goto err_debugfs;
+	}
+
+	psy_desc = devm_kzalloc(di->dev, sizeof(*psy_desc), GFP_KERNEL);
+	if (!psy_desc) {
+		ret = -ENOMEM;
+		goto err_page;
+	}
+
+	bq27xxx_probe_mark(di, BQ27XXX_PROBE_ALLOC);
+
+	psy_desc->name = di->name;
+	psy_desc->type = POWER_SUPPLY_TYPE_BATTERY;
+	psy_desc->properties = bq27xxx_battery_props[di->chip].props;
+	psy_desc->num_properties = bq27xxx_battery_props[di->chip].size;
+	psy_desc->get_property = bq27xxx_battery_get_property;
+	psy_desc->external_power_changed = bq27xxx_external_power_changed;
+
+	di->bat = power_supply_register_no_ws(di->dev, psy_desc, &psy_cfg);
+	if (IS_ERR(di->bat)) {
+		dev_err(di->dev, "Failed to register battery\n");
+		ret = PTR_ERR(di->bat);
+		goto err_page;
+	}
+
+	bq27xxx_probe_mark(di, BQ27XXX_PROBE_PSY_REGISTER);
+
+	dev_info(di->dev, "Support ver. %s enabled\n", DRIVER_VERSION);
+
+	ret = sysfs_create_group(&di->dev->kobj, &bq27xxx_battery_attr_group);
+	if (ret) {
+		dev_err(di->dev, "Failed to create sysfs attributes\n");
+		goto err_psy;
+	}
+
+	bq27xxx_events_create(di);
+	bq27xxx_capture_create(di);
+	bq27xxx_iio_register(di);
+
+	bq27xxx_probe_mark(di, BQ27XXX_PROBE_INTERFACES);
+
+	volt = bq27xxx_read(di, BQ27XXX_REG_VOLT, false);
+	if (volt < 0)
+		dev_err(di->dev, "Error reading voltage\n");
+	else
+		dev_info(di->dev, "Measured voltage: %dmV\n", volt);
+
+	bq27xxx_probe_mark(di, BQ27XXX_PROBE_VOLTAGE);
+
+	bq27xxx_bus_join(di);
+
+	bq27441_init(di);
+
+	/* Interfaces are live by now; update like the poll work does */
+	bq27xxx_lock(di, BQ27XXX_LOCK_UPDATE);
+	bq27xxx_battery_update(di);
+	bq27xxx_unlock(di);
+
+	bq27xxx_probe_mark(di, BQ27XXX_PROBE_FIRST_UPDATE);
+	dev_dbg(di->dev, "Probe took %lld us\n",
+		ktime_us_delta(di->probe.mark, di->probe.start));
+
+	return 0;
+
+err_psy:
+	power_supply_unregister(di->bat);
+err_page:
+	__free_page(di->snap_page);
+	di->snap_page = NULL;
+err_debugfs:
+	debugfs_remove_recursive(di->dfs_dev_dir);
+	bq27xxx_bus_trace_destroy(di);
+	kfree(di->bus_stats);
+	di->bus_stats = NULL;
+	return ret;
+}
+EXPORT_SYMBOL_GPL(bq27xxx_battery_setup);
+
+void bq27xxx_battery_teardown(struct bq27xxx_device_info *di)
+{
+	/*
+	 * power_supply_unregister call bq27xxx_battery_get_property which
+	 * call bq27xxx_battery_poll.
+	 * Make sure that bq27xxx_battery_poll will not call
+	 * schedule_delayed_work again after unregister (which cause OOPS).
+	 * Only this device is stopped; other gauges keep polling.
+	 */
+	spin_lock(&di->work_lock);
+	WRITE_ONCE(di->removed, true);
+	spin_unlock(&di->work_lock);
+
+	/* Files first, so nothing can re-arm what is torn down below */
+	bq27441_exit(di);
+	debugfs_remove_recursive(di->dfs_dev_dir);
+
+	bq27xxx_capture_destroy(di);
+	bq27xxx_iio_unregister(di);
+
+	cancel_work_sync(&di->urgent_work);
+	cancel_delayed_work_sync(&di->work);
+	cancel_delayed_work_sync(&di->notify_work);
+
+	bq27xxx_events_destroy(di);
+
+	sysfs_remove_group(&di->dev->kobj, &bq27xxx_battery_attr_group);
+
+	power_supply_unregister(di->bat);
+
+	/*
+	 * Updates claim the bus group; leave it only once no work, sysfs
+	 * or property read can start one, as the last member frees it.
+	 */
+	bq27xxx_bus_leave(di);
+
+	/* Existing mappings hold their own reference to the page */
+	__free_page(di->snap_page);
+	di->snap_page = NULL;
+
+	kfree(di->bus_stats);
+	di->bus_stats = NULL;
+	bq27xxx_bus_trace_destroy(di);
+
+	mutex_destroy(&di->lock);
+}
+EXPORT_SYMBOL_GPL(bq27xxx_battery_teardown);
+
+/*
+ * Quiesce the device for system suspend: stop polling and wait for any
+ * update or config session in flight to finish.
+ */
+int bq27xxx_battery_suspend(struct bq27xxx_device_info *di)
+{
+	spin_lock(&di->work_lock);
+	WRITE_ONCE(di->suspended, true);
+	di->suspend_poll_ms = 0;
+	if (time_after(di->next_poll, jiffies))
+		di->suspend_poll_ms = jiffies_to_msecs(di->next_poll - jiffies);
+	spin_unlock(&di->work_lock);
+
+	cancel_work_sync(&di->urgent_work);
+	cancel_delayed_work_sync(&di->work);
+	/* The resync on resume notifies once for everything */
+	cancel_delayed_work_sync(&di->notify_work);
+	atomic_set(&di->refresh_pending, 0);
+	bq27xxx_capture_suspend(di);
+
+	bq27xxx_lock(di, BQ27XXX_LOCK_OTHER);
+	di->suspend_time = ktime_get_boottime();
+	bq27xxx_unlock(di);
+
+	return 0;
+}
+EXPORT_SYMBOL_GPL(bq27xxx_battery_suspend);
+
+/*
+ * Resynchronise after system resume with a single snapshot burst and a
+ * single change notification, then re-arm the poll schedule. Property
+ * reads in the meantime are served from the pre-suspend snapshot.
+ */
+int bq27xxx_battery_resume(struct bq27xxx_device_info *di)
+{
+	ktime_t start = ktime_get();
+	ktime_t irq_time;
+	bool irq_seen;
+	s64 latency_us;
+	s64 remaining_ms;
+
+	di->last_suspend_ms = ktime_ms_delta(ktime_get_boottime(),
+					     di->suspend_time);
+
+	irq_seen = bq27xxx_battery_take_irq(di, &irq_time);
+
+	bq27xxx_lock(di, BQ27XXX_LOCK_UPDATE);
+	__bq27xxx_battery_update(di, false);
+	if (bq27xxx_battery_changed(di, &di->cache))
+		bq27xxx_battery_queue_event(di, &di->notified, &di->cache);
+	di->notified = di->cache;
+	di->notify_time = ktime_get();
+	bq27xxx_unlock(di);
+
+	bq27xxx_battery_power_mode(di);
+
+	spin_lock(&di->work_lock);
+	WRITE_ONCE(di->suspended, false);
+	spin_unlock(&di->work_lock);
+
+	power_supply_changed(di->bat);
+
+	latency_us = ktime_us_delta(ktime_get(), start);
+	di->resume_latency_us = latency_us;
+	if (latency_us > di->resume_latency_max_us)
+		di->resume_latency_max_us = latency_us;
+
+	if (irq_seen)
+		bq27xxx_battery_irq_latency(di, irq_time);
+
+	/*
+	 * Keep the pre-suspend schedule after a short sleep. Once the poll
+	 * fell due while asleep, the resync stands in for it and the next
+	 * one is a full slot later.
+	 */
+	remaining_ms = di->suspend_poll_ms - di->last_suspend_ms;
+	if (READ_ONCE(di->poll_interval) && remaining_ms > 0)
+		bq27xxx_battery_arm_poll(di, msecs_to_jiffies(remaining_ms));
+	else
+		bq27xxx_battery_schedule_poll(di);
+
+	return 0;
+}
+EXPORT_SYMBOL_GPL(bq27xxx_battery_resume);
+
+/*
+ * Runtime PM accounting. The bus driver calls these from its runtime
+ * callbacks; the gauge itself keeps running either way.
+ */
+void bq27xxx_battery_runtime_suspend(struct bq27xxx_device_info *di)
+{
+	unsigned long flags;
+
+	spin_lock_irqsave(&di->rpm_lock, flags);
+	if (di->rpm_active) {
+		di->rpm_active_us += ktime_us_delta(ktime_get(), di->rpm_since);
+		di->rpm_active = false;
+	}
+	spin_unlock_irqrestore(&di->rpm_lock, flags);
+}
+EXPORT_SYMBOL_GPL(bq27xxx_battery_runtime_suspend);
+
+void bq27xxx_battery_runtime_resume(struct bq27xxx_device_info *di)
+{
+	unsigned long flags;
+
+	spin_lock_irqsave(&di->rpm_lock, flags);
+	if (!di->rpm_active) {
+		di->rpm_since = ktime_get();
+		di->rpm_active = true;
+		di->rpm_resumes++;
+	}
+	spin_unlock_irqrestore(&di->rpm_lock, flags);
+}
+EXPORT_SYMBOL_GPL(bq27xxx_battery_runtime_resume);
+
+static int __bq27xxx_battery_platform_read(struct bq27xxx_device_info *di,
+					   u8 reg, bool single,
+					   unsigned int *retries)
+{
+	struct device *dev = di->dev;
+	struct bq27xxx_platform_data *pdata = dev->platform_data;
+	unsigned int timeout = 3;
+	int upper, lower;
+	int temp;
+
+	if (!single) {
+		/* Make sure the value has not changed in between reading the
+		 * lower and the upper part */
+		upper = pdata->read(dev, reg + 1);
+		do {
+			temp = upper;
+			if (upper < 0)
+				return upper;
+
+			lower = pdata->read(dev, reg);
+			if (lower < 0)
+				return lower;
+
+			upper = pdata->read(dev, reg + 1);
+			if (temp != upper)
+				(*retries)++;
+		} while (temp != upper && --timeout);
+
+		if (timeout == 0)
+			return -EIO;
+
+		return (upper << 8) | lower;
+	}
+
+	return pdata->read(dev, reg);
+}
+
+static int bq27xxx_battery_platform_read(struct bq27xxx_device_info *di, u8 reg,
+					 bool single)
+{
+	ktime_t start = ktime_get();
+	unsigned int retries = 0;
+	int ret;
+
+	ret = __bq27xxx_battery_platform_read(di, reg, single, &retries);
+	bq27xxx_bus_account(di, reg, false, NULL, single ? 2 : 3, ret,
+			    retries, start);
+
+	return ret;
+}
+
+static int bq27xxx_battery_platform_probe(struct platform_device *pdev)
+{
+	struct bq27xxx_device_info *di;
+	struct bq27xxx_platform_data *pdata = pdev->dev.platform_data;
+
+	if (!pdata) {
+		dev_err(&pdev->dev, "no platform_data supplied\n");
+		return -EINVAL;
+	}
+
+	if (!pdata->read) {
+		dev_err(&pdev->dev, "no hdq read callback supplied\n");
+		return -EINVAL;
+	}
+
+	if (!pdata->chip) {
+		dev_err(&pdev->dev, "no device supplied\n");
+		return -EINVAL;
+	}
+
+	di = devm_kzalloc(&pdev->dev, sizeof(*di), GFP_KERNEL);
+	if (!di)
+		return -ENOMEM;
+
+	platform_set_drvdata(pdev, di);
+
+	di->dev = &pdev->dev;
+	di->chip = pdata->chip;
+	di->name = pdata->name ?: dev_name(&pdev->dev);
+	di->bus.read = bq27xxx_battery_platform_read;
+
+	return bq27xxx_battery_setup(di);
+}
+
+static int bq27xxx_battery_platform_remove(struct platform_device *pdev)
+{
+	struct bq27xxx_device_info *di = platform_get_drvdata(pdev);
+
+	bq27xxx_battery_teardown(di);
+
+	return 0;
+}
+
+#ifdef CONFIG_PM_SLEEP
+static int bq27xxx_battery_platform_suspend(struct device *dev)
+{
+	struct bq27xxx_device_info *di = dev_get_drvdata(dev);
+
+	return bq27xxx_battery_suspend(di);
+}
+
+static int bq27xxx_battery_platform_resume(struct device *dev)
+{
+	struct bq27xxx_device_info *di = dev_get_drvdata(dev);
+
+	return bq27xxx_battery_resume(di);
+}
+#endif /* CONFIG_PM_SLEEP */
+
+static SIMPLE_DEV_PM_OPS(bq27xxx_battery_platform_pm_ops,
+			 bq27xxx_battery_platform_suspend,
+			 bq27xxx_battery_platform_resume);
+
+static const struct platform_device_id bq27xxx_battery_platform_id_table[] = {
+	{ "bq27000-battery", },
+	{ /* sentinel */ }
+};
+MODULE_DEVICE_TABLE(platform, bq27xxx_battery_platform_id_table);
+
+#ifdef CONFIG_OF
+static const struct of_device_id bq27xxx_battery_platform_of_match_table[] = {
+	{ .compatible = "ti,bq27000" },
+	{},
+};
+MODULE_DEVICE_TABLE(of, bq27xxx_battery_platform_of_match_table);
+#endif
+
+static struct platform_driver bq27xxx_battery_platform_driver = {
+	.probe	= bq27xxx_battery_platform_probe,
+	.remove = bq27xxx_battery_platform_remove,
+	.driver = {
+		.name = "bq27000-battery",
+		.of_match_table = of_match_ptr(bq27xxx_battery_platform_of_match_table),
+		.pm = &bq27xxx_battery_platform_pm_ops,
+	},
+	.id_table = bq27xxx_battery_platform_id_table,
+};
+
+static int __init bq27xxx_battery_init(void)
+{
+	int ret;
+
+	bq27xxx_wq = alloc_workqueue("bq27xxx", WQ_UNBOUND | WQ_FREEZABLE |
+				     WQ_POWER_EFFICIENT, 0);
+	if (!bq27xxx_wq)
+		return -ENOMEM;
+
+	bq27xxx_urgent_wq = alloc_workqueue("bq27xxx_urgent",
+					    WQ_HIGHPRI | WQ_FREEZABLE, 0);
+	if (!bq27xxx_urgent_wq) {
+		ret = -ENOMEM;
+		goto err_wq;
+	}
+
+	bq27xxx_dfs_root = debugfs_create_dir("bq27xxx", NULL);
+	bq27xxx_dfs_devices = debugfs_create_dir("devices", bq27xxx_dfs_root);
+	bq27xxx_dfs_buses = debugfs_create_dir("buses", bq27xxx_dfs_root);
+
+	ret = platform_driver_register(&bq27xxx_battery_platform_driver);
+	if (ret)
+		goto err_register;
+
+	return 0;
+
+err_register:
+	debugfs_remove_recursive(bq27xxx_dfs_root);
+	destroy_workqueue(bq27xxx_urgent_wq);
+err_wq:
+	destroy_workqueue(bq27xxx_wq);
+	return ret;
+}
+module_init(bq27xxx_battery_init);
+
+static void __exit bq27xxx_battery_exit(void)
+{
+	platform_driver_unregister(&bq27xxx_battery_platform_driver);
+
+	debugfs_remove_recursive(bq27xxx_dfs_root);
+	destroy_workqueue(bq27xxx_urgent_wq);
+	destroy_workqueue(bq27xxx_wq);
+}
+module_exit(bq27xxx_battery_exit);
+
+MODULE_ALIAS("platform:bq27000-battery");
+
+MODULE_AUTHOR("Rodolfo Giometti <giometti@linux.it>");
+MODULE_DESCRIPTION("BQ27xxx battery monitor driver");
+MODULE_LICENSE("GPL");
+
@@ -0,0 +1,308 @@
+/*
+ * BQ27xxx battery driver - event file
+ *
+ * This package is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * THIS PACKAGE IS PROVIDED ``AS IS'' AND WITHOUT ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, WITHOUT LIMITATION, THE IMPLIED
+ * WARRANTIES OF MERCHANTIBILITY AND FITNESS FOR A PARTICULAR PURPOSE.
+ */
+
+#include <linux/device.h>
+#include <linux/module.h>
+#include <linux/slab.h>
+#include <linux/spinlock.h>
+#include <linux/mutex.h>
+#include <linux/kref.h>
+#include <linux/miscdevice.h>
+#include <linux/poll.h>
+#include <linux/uaccess.h>
+#include <linux/power_supply.h>
+
+#include "bq27xxx_battery.h"
+#include "bq27xxx_internal.h"
+#include "bq27xxx_snapshot.h"
+
+#define BQ27XXX_EVENT_RING		64 /* Records kept for slow readers */
+
+/*
+ * Event file
+ *
+ * Every detected change is appended to a small ring that readers of
+ * /dev/<battery>-events consume at their own pace. The ring outlives the
+ * gauge while files are still open.
+ */
+struct bq27xxx_events {
+	struct kref ref;
+	struct miscdevice misc;
+	char name[32];
+	spinlock_t lock;
+	wait_queue_head_t wait;
+	struct bq27xxx_event ring[BQ27XXX_EVENT_RING];
+	u64 seq; /* of the newest record, 0 while empty */
+	bool dead;
+};
+
+struct bq27xxx_event_reader {
+	struct bq27xxx_events *ev;
+	struct mutex lock;
+	u64 seq; /* of the last record read */
+};
+
+static void bq27xxx_events_release_ref(struct kref *ref)
+{
+	kfree(container_of(ref, struct bq27xxx_events, ref));
+}
+
+static void bq27xxx_event_values(const struct bq27xxx_reg_cache *cache,
+				 __s32 *val)
+{
+	val[BQ27XXX_EVENT_FLAGS] = cache->flags;
+	val[BQ27XXX_EVENT_CAPACITY] = cache->capacity;
+	val[BQ27XXX_EVENT_VOLTAGE] = cache->voltage < 0 ? cache->voltage :
+							  cache->voltage * 1000;
+	val[BQ27XXX_EVENT_TEMP] = cache->temperature < 0 ? cache->temperature :
+							   cache->temperature - 2731;
+	val[BQ27XXX_EVENT_HEALTH] = cache->health;
+}
+
+/* Fill both value arrays and return the mask of fields that differ */
+static u32 bq27xxx_event_mask_values(const struct bq27xxx_reg_cache *old,
+				     const struct bq27xxx_reg_cache *cache,
+				     __s32 *old_val, __s32 *new_val)
+{
+	u32 mask = 0;
+	int i;
+
+	bq27xxx_event_values(old, old_val);
+	bq27xxx_event_values(cache, new_val);
+	for (i = 0; i < BQ27XXX_EVENT_FIELDS; i++)
+		if (old_val[i] != new_val[i])
+			mask |= BIT(i);
+
+	return mask;
+}
+
+u32 bq27xxx_event_mask(const struct bq27xxx_reg_cache *old,
+		       const struct bq27xxx_reg_cache *cache)
+{
+	__s32 old_val[BQ27XXX_EVENT_FIELDS], new_val[BQ27XXX_EVENT_FIELDS];
+
+	return bq27xxx_event_mask_values(old, cache, old_val, new_val);
+}
+
+/* Called with di->lock held */
+void bq27xxx_battery_queue_event(struct bq27xxx_device_info *di,
+				 const struct bq27xxx_reg_cache *old,
+				 const struct bq27xxx_reg_cache *cache)
+{
+	struct bq27xxx_events *ev = di->events;
+	struct bq27xxx_event rec = {
+		.timestamp_ns = ktime_get_ns(),
+	};
+
+	if (!ev)
+		return;
+
+	rec.mask = bq27xxx_event_mask_values(old, cache, rec.old_val,
+					     rec.new_val);
+
+	spin_lock(&ev->lock);
+	rec.seq = ++ev->seq;
+	ev->ring[rec.seq % BQ27XXX_EVENT_RING] = rec;
+	spin_unlock(&ev->lock);
+
+	wake_up_interruptible(&ev->wait);
+}
+
+static int bq27xxx_events_open(struct inode *inode, struct file *filp)
+{
+	struct bq27xxx_events *ev = container_of(filp->private_data,
+						 struct bq27xxx_events, misc);
+	struct bq27xxx_event_reader *r;
+
+	r = kzalloc(sizeof(*r), GFP_KERNEL);
+	if (!r)
+		return -ENOMEM;
+
+	mutex_init(&r->lock);
+	r->ev = ev;
+	kref_get(&ev->ref);
+
+	spin_lock(&ev->lock);
+	r->seq = ev->seq;
+	spin_unlock(&ev->lock);
+
+	filp->private_data = r;
+
+	return nonseekable_open(inode, filp);
+}
+
+static int bq27xxx_events_release(struct inode *inode, struct file *filp)
+{
+	struct bq27xxx_event_reader *r = filp->private_data;
+
+	kref_put(&r->ev->ref, bq27xxx_events_release_ref);
+	mutex_destroy(&r->lock);
+	kfree(r);
+
+	return 0;
+}
+
+/* Take the next unread record, if any. Called with ev->lock held. */
+static bool bq27xxx_events_next(struct bq27xxx_events *ev,
+				struct bq27xxx_event_reader *r,
+				struct bq27xxx_event *rec)
+{
+	u64 oldest;
+	bool overflow = false;
+
+	if (ev->seq == r->seq)
+		return false;
+
+	oldest = ev->seq > BQ27XXX_EVENT_RING ?
+			ev->seq - BQ27XXX_EVENT_RING + 1 : 1;
+	if (r->seq + 1 < oldest) {
+		r->seq = oldest - 1;
+		overflow = true;
+	}
+
+	*rec = ev->ring[(r->seq + 1) % BQ27XXX_EVENT_RING];
+	if (overflow)
+		rec->mask |= BQ27XXX_EVENT_OVERFLOW;
+
+	return true;
+}
+
+static ssize_t bq27xxx_events_read(struct file *filp, char __user *buf,
+				   size_t count, loff_t *ppos)
+{
+	struct bq27xxx_event_reader *r = filp->private_data;
+	struct bq27xxx_events *ev = r->ev;
+	struct bq27xxx_event rec;
+	size_t done = 0;
+	bool more;
+	int ret;
+
+	if (count < sizeof(rec))
+		return -EINVAL;
+
+	mutex_lock(&r->lock);
+
+	while (READ_ONCE(ev->seq) == r->seq) {
+		if (READ_ONCE(ev->dead)) {
+			ret = 0;
+			goto out;
+		}
+		if (filp->f_flags & O_NONBLOCK) {
+			ret = -EAGAIN;
+			goto out;
+		}
+
+		mutex_unlock(&r->lock);
+		ret = wait_event_interruptible(ev->wait,
+				READ_ONCE(ev->seq) != r->seq ||
+				READ_ONCE(ev->dead));
+		if (ret)
+			return ret;
+		mutex_lock(&r->lock);
+	}
+
+	while (done + sizeof(rec) <= count) {
+		spin_lock(&ev->lock);
+		more = bq27xxx_events_next(ev, r, &rec);
+		spin_unlock(&ev->lock);
+		if (!more)
+			break;
+
+		if (copy_to_user(buf + done, &rec, sizeof(rec))) {
+			ret = done ? done : -EFAULT;
+			goto out;
+		}
+
+		r->seq = rec.seq;
+		done += sizeof(rec);
+	}
+	ret = done;
+
+out:
+	mutex_unlock(&r->lock);
+
+	return ret;
+}
+
+static __poll_t bq27xxx_events_poll(struct file *filp, poll_table *wait)
+{
+	struct bq27xxx_event_reader *r = filp->private_data;
+	struct bq27xxx_events *ev = r->ev;
+	__poll_t mask = 0;
+
+	poll_wait(filp, &ev->wait, wait);
+
+	if (READ_ONCE(ev->seq) != READ_ONCE(r->seq))
+		mask |= EPOLLIN | EPOLLRDNORM;
+	if (READ_ONCE(ev->dead))
+		mask |= EPOLLHUP;
+
+	return mask;
+}
+
+static const struct file_operations bq27xxx_events_fops = {
+	.owner = THIS_MODULE,
+	.open = bq27xxx_events_open,
+	.release = bq27xxx_events_release,
+	.read = bq27xxx_events_read,
+	.poll = bq27xxx_events_poll,
+	.llseek = no_llseek,
+};
+
+/* Not fatal if it fails; the gauge just has no event file */
+void bq27xxx_events_create(struct bq27xxx_device_info *di)
+{
+	struct bq27xxx_events *ev;
+
+	ev = kzalloc(sizeof(*ev), GFP_KERNEL);
+	if (!ev)
+		return;
+
+	kref_init(&ev->ref);
+	spin_lock_init(&ev->lock);
+	init_waitqueue_head(&ev->wait);
+	snprintf(ev->name, sizeof(ev->name), "%s-events", di->name);
+	ev->misc.minor = MISC_DYNAMIC_MINOR;
+	ev->misc.name = ev->name;
+	ev->misc.fops = &bq27xxx_events_fops;
+	ev->misc.parent = di->dev;
+
+	if (misc_register(&ev->misc)) {
+		dev_warn(di->dev, "Failed to register %s\n", ev->name);
+		kfree(ev);
+		return;
+	}
+
+	di->events = ev;
+}
+
+void bq27xxx_events_destroy(struct bq27xxx_device_info *di)
+{
+	struct bq27xxx_events *ev;
+
+	bq27xxx_lock(di, BQ27XXX_LOCK_OTHER);
+	ev = di->events;
+	di->events = NULL;
+	bq27xxx_unlock(di);
+
+	if (!ev)
+		return;
+
+	misc_deregister(&ev->misc);
+
+	/* Wake blocked readers; they see EOF once drained */
+	WRITE_ONCE(ev->dead, true);
+	wake_up_interruptible(&ev->wait);
+
+	kref_put(&ev->ref, bq27xxx_events_release_ref);
+}
+
@@ -0,0 +1,304 @@
+/*
+ * BQ27xxx battery driver - IIO interface
+ *
+ * This package is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * THIS PACKAGE IS PROVIDED ``AS IS'' AND WITHOUT ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, WITHOUT LIMITATION, THE IMPLIED
+ * WARRANTIES OF MERCHANTIBILITY AND FITNESS FOR A PARTICULAR PURPOSE.
+ */
+
+#include <linux/device.h>
+#include <linux/module.h>
+#include <linux/jiffies.h>
+#include <linux/delay.h>
+#include <linux/ktime.h>
+#include <linux/power_supply.h>
+#include <linux/iio/iio.h>
+#include <linux/iio/buffer.h>
+#include <linux/iio/trigger_consumer.h>
+#include <linux/iio/triggered_buffer.h>
+
+#include "bq27xxx_battery.h"
+#include "bq27xxx_internal.h"
+
+#define BQ27XXX_IIO_WAIT_MS		100 /* Direct reads wait out updates */
+
+#if IS_ENABLED(CONFIG_IIO)
+/*
+ * IIO interface
+ *
+ * Raw values are in micro-units (uV, uA, uW) and tenths of a kelvin, so
+ * one scale covers every gauge family. Buffered mode fills each scan from
+ * one burst, claimed against the bus group like a snapshot.
+ */
+enum bq27xxx_iio_scan {
+	BQ27XXX_IIO_VOLTAGE = 0,
+	BQ27XXX_IIO_CURRENT,
+	BQ27XXX_IIO_POWER,
+	BQ27XXX_IIO_TEMP,
+	BQ27XXX_IIO_INT_TEMP,
+	BQ27XXX_IIO_TIMESTAMP,
+};
+
+#define BQ27XXX_IIO_CHAN(_type, _chan, _index, _name, _extra)		\
+	{								\
+		.type = _type,						\
+		.indexed = 1,						\
+		.channel = _chan,					\
+		.info_mask_separate = BIT(IIO_CHAN_INFO_RAW) |		\
+				      BIT(IIO_CHAN_INFO_SCALE) | (_extra),	\
+		.scan_index = _index,					\
+		.scan_type = {						\
+			.sign = 's',					\
+			.realbits = 32,					\
+			.storagebits = 32,				\
+			.endianness = IIO_CPU,				\
+		},							\
+		.datasheet_name = _name,				\
+	}
+
+static const struct {
+	enum bq27xxx_reg_index reg;
+	struct iio_chan_spec chan;
+} bq27xxx_iio_channels[] = {
+	{ BQ27XXX_REG_VOLT, BQ27XXX_IIO_CHAN(IIO_VOLTAGE, 0,
+		BQ27XXX_IIO_VOLTAGE, "VOLT", 0) },
+	{ BQ27XXX_REG_AI, BQ27XXX_IIO_CHAN(IIO_CURRENT, 0,
+		BQ27XXX_IIO_CURRENT, "AI", 0) },
+	{ BQ27XXX_REG_AP, BQ27XXX_IIO_CHAN(IIO_POWER, 0,
+		BQ27XXX_IIO_POWER, "AP", 0) },
+	{ BQ27XXX_REG_TEMP, BQ27XXX_IIO_CHAN(IIO_TEMP, 0,
+		BQ27XXX_IIO_TEMP, "TEMP", BIT(IIO_CHAN_INFO_OFFSET)) },
+	{ BQ27XXX_REG_INT_TEMP, BQ27XXX_IIO_CHAN(IIO_TEMP, 1,
+		BQ27XXX_IIO_INT_TEMP, "INT_TEMP", BIT(IIO_CHAN_INFO_OFFSET)) },
+};
+
+static int bq27xxx_iio_read(struct bq27xxx_device_info *di,
+			    enum bq27xxx_iio_scan index, int *val)
+{
+	int ret;
+
+	switch (index) {
+	case BQ27XXX_IIO_VOLTAGE:
+		ret = bq27xxx_read(di, BQ27XXX_REG_VOLT, false);
+		if (ret >= 0)
+			*val = ret * 1000;
+		break;
+	case BQ27XXX_IIO_CURRENT:
+		ret = bq27xxx_read(di, BQ27XXX_REG_AI, false);
+		if (ret >= 0)
+			*val = bq27xxx_battery_current_ua(di,
+					READ_ONCE(di->cache.flags), ret);
+		break;
+	case BQ27XXX_IIO_POWER:
+		ret = bq27xxx_read(di, BQ27XXX_REG_AP, false);
+		if (ret < 0)
+			break;
+		if (di->chip == BQ27000 || di->chip == BQ27010)
+			*val = ret * BQ27XXX_POWER_CONSTANT / BQ27XXX_RS;
+		else
+			*val = (int)((s16)ret) * 1000; /* signed mW */
+		break;
+	case BQ27XXX_IIO_TEMP:
+		ret = bq27xxx_battery_read_temperature(di);
+		if (ret >= 0)
+			*val = ret;
+		break;
+	case BQ27XXX_IIO_INT_TEMP:
+		ret = bq27xxx_read(di, BQ27XXX_REG_INT_TEMP, false);
+		if (ret >= 0)
+			*val = ret;
+		break;
+	default:
+		return -EINVAL;
+	}
+
+	return ret < 0 ? ret : 0;
+}
+
+/*
+ * Take di->lock for a direct read without ever queueing behind a config
+ * session: wait out an update for at most BQ27XXX_IIO_WAIT_MS, and fail
+ * as soon as a maintenance operation is pending. The lock is only ever
+ * tried, so a session that starts meanwhile is seen on the next round.
+ */
+static int bq27xxx_iio_lock(struct bq27xxx_device_info *di)
+{
+	unsigned long timeout = jiffies + msecs_to_jiffies(BQ27XXX_IIO_WAIT_MS);
+
+	while (!bq27xxx_trylock(di, BQ27XXX_LOCK_SAMPLE)) {
+		if (atomic_read(&di->maint_active) ||
+		    time_after(jiffies, timeout)) {
+			bq27xxx_lock_skipped(di, BQ27XXX_LOCK_SAMPLE);
+			return -EBUSY;
+		}
+		usleep_range(500, 1000);
+	}
+
+	return 0;
+}
+
+static int bq27xxx_iio_read_raw(struct iio_dev *indio_dev,
+				struct iio_chan_spec const *chan,
+				int *val, int *val2, long mask)
+{
+	struct bq27xxx_device_info *di =
+			*(struct bq27xxx_device_info **)iio_priv(indio_dev);
+	int ret;
+
+	switch (mask) {
+	case IIO_CHAN_INFO_RAW:
+		/* Scans own the bus while the buffer is enabled */
+		ret = iio_device_claim_direct_mode(indio_dev);
+		if (ret)
+			return ret;
+
+		ret = bq27xxx_iio_lock(di);
+		if (ret) {
+			iio_device_release_direct_mode(indio_dev);
+			return ret;
+		}
+
+		ret = bq27xxx_iio_read(di, chan->scan_index, val);
+		bq27xxx_unlock(di);
+		iio_device_release_direct_mode(indio_dev);
+		if (ret)
+			return ret;
+		return IIO_VAL_INT;
+	case IIO_CHAN_INFO_SCALE:
+		if (chan->type == IIO_TEMP) {
+			*val = 100; /* 0.1 K to milli degrees */
+			return IIO_VAL_INT;
+		}
+		*val = 0;
+		*val2 = 1000; /* micro- to milli-units */
+		return IIO_VAL_INT_PLUS_MICRO;
+	case IIO_CHAN_INFO_OFFSET:
+		*val = -2731;
+		return IIO_VAL_INT;
+	default:
+		return -EINVAL;
+	}
+}
+
+static const struct iio_info bq27xxx_iio_info = {
+	.read_raw = bq27xxx_iio_read_raw,
+};
+
+static irqreturn_t bq27xxx_iio_trigger_handler(int irq, void *p)
+{
+	struct iio_poll_func *pf = p;
+	struct iio_dev *indio_dev = pf->indio_dev;
+	struct bq27xxx_device_info *di =
+			*(struct bq27xxx_device_info **)iio_priv(indio_dev);
+	struct {
+		s32 data[BQ27XXX_IIO_TIMESTAMP];
+		s64 timestamp __aligned(8);
+	} scan;
+	struct bq27xxx_bus_group *group;
+	ktime_t bus_start;
+	int bit, i = 0, ret = 0;
+
+	if (READ_ONCE(di->suspended))
+		goto done;
+
+	/* Skip this scan while a config session or update holds the gauge */
+	if (!bq27xxx_trylock(di, BQ27XXX_LOCK_SAMPLE)) {
+		bq27xxx_lock_skipped(di, BQ27XXX_LOCK_SAMPLE);
+		goto done;
+	}
+
+	memset(&scan, 0, sizeof(scan));
+
+	ret = bq27xxx_pm_get(di);
+	if (ret < 0) {
+		bq27xxx_pm_put(di);
+		bq27xxx_unlock(di);
+		goto done;
+	}
+
+	group = bq27xxx_bus_claim(di, &bus_start);
+	for_each_set_bit(bit, indio_dev->active_scan_mask,
+			 indio_dev->masklength) {
+		if (bit == BQ27XXX_IIO_TIMESTAMP)
+			continue;
+		ret = bq27xxx_iio_read(di, bit, &scan.data[i++]);
+		if (ret)
+			break;
+	}
+	bq27xxx_bus_release(group, bus_start);
+	bq27xxx_pm_put(di);
+	bq27xxx_unlock(di);
+
+	/* Drop a scan with a failed read rather than push stale fields */
+	if (!ret)
+		iio_push_to_buffers_with_timestamp(indio_dev, &scan,
+						   pf->timestamp);
+
+done:
+	iio_trigger_notify_done(indio_dev->trig);
+
+	return IRQ_HANDLED;
+}
+
+/* Not fatal if it fails; the power_supply interface is unaffected */
+void bq27xxx_iio_register(struct bq27xxx_device_info *di)
+{
+	struct iio_chan_spec *channels;
+	struct iio_dev *indio_dev;
+	int i, n = 0, ret;
+
+	indio_dev = devm_iio_device_alloc(di->dev, sizeof(di));
+	if (!indio_dev)
+		return;
+
+	channels = devm_kcalloc(di->dev, ARRAY_SIZE(bq27xxx_iio_channels) + 1,
+				sizeof(*channels), GFP_KERNEL);
+	if (!channels)
+		return;
+
+	/* Scan indexes stay fixed; gauges just lack some channels */
+	for (i = 0; i < ARRAY_SIZE(bq27xxx_iio_channels); i++)
+		if (di->regs[bq27xxx_iio_channels[i].reg] != INVALID_REG_ADDR)
+			channels[n++] = bq27xxx_iio_channels[i].chan;
+	channels[n++] = (struct iio_chan_spec)
+			IIO_CHAN_SOFT_TIMESTAMP(BQ27XXX_IIO_TIMESTAMP);
+
+	*(struct bq27xxx_device_info **)iio_priv(indio_dev) = di;
+	indio_dev->dev.parent = di->dev;
+	indio_dev->name = di->name;
+	indio_dev->info = &bq27xxx_iio_info;
+	indio_dev->modes = INDIO_DIRECT_MODE;
+	indio_dev->channels = channels;
+	indio_dev->num_channels = n;
+
+	ret = iio_triggered_buffer_setup(indio_dev, iio_pollfunc_store_time,
+					 bq27xxx_iio_trigger_handler, NULL);
+	if (ret) {
+		dev_warn(di->dev, "Failed to set up IIO buffer: %d\n", ret);
+		return;
+	}
+
+	ret = iio_device_register(indio_dev);
+	if (ret) {
+		dev_warn(di->dev, "Failed to register IIO device: %d\n", ret);
+		iio_triggered_buffer_cleanup(indio_dev);
+		return;
+	}
+
+	di->iio = indio_dev;
+}
+
+void bq27xxx_iio_unregister(struct bq27xxx_device_info *di)
+{
+	if (!di->iio)
+		return;
+
+	iio_device_unregister(di->iio);
+	iio_triggered_buffer_cleanup(di->iio);
+	di->iio = NULL;
+}
+#endif /* CONFIG_IIO */
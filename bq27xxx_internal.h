@@ -0,0 +1,108 @@
+#ifndef __BQ27XXX_INTERNAL_H__
+#define __BQ27XXX_INTERNAL_H__
+
+/*
+ * Shared between the objects of the bq27xxx_battery module only; the
+ * interface to bus drivers and bq27441_battery is bq27xxx_battery.h.
+ */
+
+#define INVALID_REG_ADDR	0xff
+
+#define BQ27XXX_RS			(20) /* Resistor sense mOhm */
+#define BQ27XXX_POWER_CONSTANT		(29200) /* 29.2 µV^2 * 1000 */
+#define BQ27XXX_CURRENT_CONSTANT	(3570) /* 3.57 µV * 1000 */
+
+/*
+ * bq27xxx_reg_index - Register names
+ *
+ * These are indexes into a device's register mapping array.
+ */
+enum bq27xxx_reg_index {
+	BQ27XXX_REG_CTRL = 0,	/* Control */
+	BQ27XXX_REG_TEMP,	/* Temperature */
+	BQ27XXX_REG_INT_TEMP,	/* Internal Temperature */
+	BQ27XXX_REG_VOLT,	/* Voltage */
+	BQ27XXX_REG_AI,		/* Average Current */
+	BQ27XXX_REG_FLAGS,	/* Flags */
+	BQ27XXX_REG_TTE,	/* Time-to-Empty */
+	BQ27XXX_REG_TTF,	/* Time-to-Full */
+	BQ27XXX_REG_TTES,	/* Time-to-Empty Standby */
+	BQ27XXX_REG_TTECP,	/* Time-to-Empty at Constant Power */
+	BQ27XXX_REG_NAC,	/* Nominal Available Capacity */
+	BQ27XXX_REG_FCC,	/* Full Charge Capacity */
+	BQ27XXX_REG_CYCT,	/* Cycle Count */
+	BQ27XXX_REG_AE,		/* Available Energy */
+	BQ27XXX_REG_SOC,	/* State-of-Charge */
+	BQ27XXX_REG_DCAP,	/* Design Capacity */
+	BQ27XXX_REG_AP,		/* Average Power */
+};
+
+struct bq27xxx_reg_cache;
+
+/* bq27xxx_core.c */
+extern struct workqueue_struct *bq27xxx_wq;
+extern struct workqueue_struct *bq27xxx_urgent_wq;
+extern struct dentry *bq27xxx_dfs_buses;
+
+int bq27xxx_battery_read_temperature(struct bq27xxx_device_info *di);
+int bq27xxx_battery_read_pwr_avg(struct bq27xxx_device_info *di);
+int bq27xxx_battery_current_ua(struct bq27xxx_device_info *di,
+			       int flags, int curr);
+
+static inline int bq27xxx_read(struct bq27xxx_device_info *di, int reg_index,
+			       bool single)
+{
+	/* Reports EINVAL for invalid/missing registers */
+	if (!di || di->regs[reg_index] == INVALID_REG_ADDR)
+		return -EINVAL;
+
+	return di->bus.read(di, di->regs[reg_index], single);
+}
+
+/* bq27xxx_bus.c */
+void bq27xxx_bus_join(struct bq27xxx_device_info *di);
+void bq27xxx_bus_leave(struct bq27xxx_device_info *di);
+void bq27xxx_bus_batch(struct bq27xxx_device_info *di);
+unsigned long bq27xxx_bus_slot_delay(struct bq27xxx_device_info *di,
+				     unsigned int interval, u64 min_ns);
+void bq27xxx_bus_stats_create(struct bq27xxx_device_info *di);
+void bq27xxx_dev_debugfs_create(struct bq27xxx_device_info *di);
+
+#ifdef CONFIG_DEBUG_FS
+void bq27xxx_bus_trace_create(struct bq27xxx_device_info *di);
+void bq27xxx_bus_trace_destroy(struct bq27xxx_device_info *di);
+#else
+static inline void bq27xxx_bus_trace_create(struct bq27xxx_device_info *di) {}
+static inline void bq27xxx_bus_trace_destroy(struct bq27xxx_device_info *di) {}
+#endif
+
+/* bq27xxx_events.c */
+u32 bq27xxx_event_mask(const struct bq27xxx_reg_cache *old,
+		       const struct bq27xxx_reg_cache *cache);
+void bq27xxx_battery_queue_event(struct bq27xxx_device_info *di,
+				 const struct bq27xxx_reg_cache *old,
+				 const struct bq27xxx_reg_cache *cache);
+void bq27xxx_events_create(struct bq27xxx_device_info *di);
+void bq27xxx_events_destroy(struct bq27xxx_device_info *di);
+
+/* bq27xxx_capture.c */
+#ifdef CONFIG_DEBUG_FS
+void bq27xxx_capture_create(struct bq27xxx_device_info *di);
+void bq27xxx_capture_suspend(struct bq27xxx_device_info *di);
+void bq27xxx_capture_destroy(struct bq27xxx_device_info *di);
+#else
+static inline void bq27xxx_capture_create(struct bq27xxx_device_info *di) {}
+static inline void bq27xxx_capture_suspend(struct bq27xxx_device_info *di) {}
+static inline void bq27xxx_capture_destroy(struct bq27xxx_device_info *di) {}
+#endif
+
+/* bq27xxx_iio.c */
+#if IS_ENABLED(CONFIG_IIO)
+void bq27xxx_iio_register(struct bq27xxx_device_info *di);
+void bq27xxx_iio_unregister(struct bq27xxx_device_info *di);
+#else
+static inline void bq27xxx_iio_register(struct bq27xxx_device_info *di) {}
+static inline void bq27xxx_iio_unregister(struct bq27xxx_device_info *di) {}
+#endif
+
+#endif /* __BQ27XXX_INTERNAL_H__ */
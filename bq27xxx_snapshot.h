@@ -0,0 +1,134 @@
+#ifndef __LINUX_BQ27XXX_SNAPSHOT_H__
+#define __LINUX_BQ27XXX_SNAPSHOT_H__
+
+#include <linux/types.h>
+
+/*
+ * Layout of the "snapshot" binary sysfs attribute of a bq27xxx gauge.
+ *
+ * One read() returns the whole cached snapshot. Values use the units of
+ * the matching power_supply properties; a negative value is the -errno
+ * the gauge returned for that register.
+ *
+ * New fields are only ever appended. Readers should check @version and
+ * use @size to skip fields they do not know about.
+ */
+#define BQ27XXX_SNAPSHOT_VERSION	1
+
+struct bq27xxx_snapshot {
+	__u32 version;
+	__u32 size;		/* sizeof(struct bq27xxx_snapshot) */
+	__u64 seq;		/* bumped on every snapshot burst */
+	__u64 timestamp_ns;	/* CLOCK_MONOTONIC time of the burst */
+	__s32 flags;		/* raw FLAGS register */
+	__s32 status;		/* POWER_SUPPLY_STATUS_* */
+	__s32 health;		/* POWER_SUPPLY_HEALTH_* */
+	__s32 capacity;		/* percent */
+	__s32 voltage_uv;
+	__s32 current_ua;
+	__s32 temp;		/* tenths of a degree Celsius */
+	__s32 charge_now_uah;
+	__s32 charge_full_uah;
+	__s32 charge_full_design_uah;
+	__s32 energy_uwh;
+	__s32 power_avg_uw;
+	__s32 time_to_empty_s;
+	__s32 time_to_empty_avg_s;
+	__s32 time_to_full_s;
+	__s32 cycle_count;
+};
+
+/*
+ * Layout of the read-only "snapshot_page" that userspace may mmap().
+ *
+ * @seq is odd while the driver rewrites @snap. A reader loads @seq, then
+ * copies @snap, then reloads @seq. The copy is coherent if both loads
+ * return the same even value; otherwise the reader retries.
+ */
+struct bq27xxx_snapshot_page {
+	__u32 seq;
+	__u32 reserved;
+	struct bq27xxx_snapshot snap;
+};
+
+/*
+ * Records returned by read() on /dev/<battery>-events. Each record
+ * describes one detected change: @mask has BIT(field) set for every
+ * field whose value differs, and @old_val / @new_val hold all fields
+ * before and after, indexed by enum bq27xxx_event_field, in the units
+ * used by struct bq27xxx_snapshot.
+ *
+ * A reader only sees changes made after it opened the file. If it falls
+ * so far behind that records were dropped, the first record it gets
+ * afterwards has BQ27XXX_EVENT_OVERFLOW set in @mask.
+ */
+enum bq27xxx_event_field {
+	BQ27XXX_EVENT_FLAGS = 0,
+	BQ27XXX_EVENT_CAPACITY,
+	BQ27XXX_EVENT_VOLTAGE,
+	BQ27XXX_EVENT_TEMP,
+	BQ27XXX_EVENT_HEALTH,
+	BQ27XXX_EVENT_FIELDS,
+};
+
+#define BQ27XXX_EVENT_OVERFLOW	(1U << 31)
+
+struct bq27xxx_event {
+	__u64 seq;
+	__u64 timestamp_ns;	/* CLOCK_MONOTONIC */
+	__u32 mask;
+	__u32 reserved;
+	__s32 old_val[BQ27XXX_EVENT_FIELDS];
+	__s32 new_val[BQ27XXX_EVENT_FIELDS];
+};
+
+/*
+ * Records drained from the capture_data debugfs file while a high-rate
+ * capture runs. Values use the units of struct bq27xxx_snapshot; a
+ * negative value is the -errno of a failed read.
+ */
+struct bq27xxx_sample {
+	__u64 timestamp_ns;	/* CLOCK_MONOTONIC */
+	__s32 current_ua;
+	__s32 voltage_uv;
+	__s32 power_avg_uw;
+	__u32 reserved;
+};
+
+
+/*
+ * Bus trace drained from the bus_trace_data debugfs file while a
+ * recording runs. The stream starts with one struct
+ * bq27xxx_bus_trace_header; then every transaction is one struct
+ * bq27xxx_bus_record followed directly by @len data bytes, unpadded.
+ *
+ * The data is what was written after the register address, or the
+ * little-endian value read (zeros if the read failed). @result is what
+ * the bus backend returned: the bytes sent for a write, 0 for a read,
+ * or a negative errno. BQ27XXX_BUS_GAP marks the first record after
+ * records were dropped on a full buffer.
+ */
+#define BQ27XXX_BUS_TRACE_MAGIC		0x52545142	/* "BQTR" */
+#define BQ27XXX_BUS_TRACE_VERSION	1
+
+#define BQ27XXX_BUS_WRITE	(1 << 0)
+#define BQ27XXX_BUS_GAP		(1 << 1)
+
+struct bq27xxx_bus_trace_header {
+	__u32 magic;
+	__u32 version;
+	__u32 chip;		/* enum bq27xxx_chip */
+	__u32 reserved;
+};
+
+struct bq27xxx_bus_record {
+	__u64 timestamp_ns;	/* CLOCK_MONOTONIC start of the transaction */
+	__u32 duration_ns;
+	__s32 result;
+	__u8 reg;
+	__u8 flags;
+	__u8 len;
+	__u8 reserved[5];
+};
+
+#endif
@@ -0,0 +1,117 @@
+#undef TRACE_SYSTEM
+#define TRACE_SYSTEM bq27xxx
+
+#if !defined(_BQ27XXX_TRACE_H) || defined(TRACE_HEADER_MULTI_READ)
+#define _BQ27XXX_TRACE_H
+
+#include <linux/device.h>
+#include <linux/tracepoint.h>
+
+DECLARE_EVENT_CLASS(bq27xxx_reg,
+
+	TP_PROTO(struct device *dev, u8 reg, size_t bytes, int ret, u64 ns),
+
+	TP_ARGS(dev, reg, bytes, ret, ns),
+
+	TP_STRUCT__entry(
+		__string(dev, dev_name(dev))
+		__field(u8, reg)
+		__field(u8, bytes)
+		__field(int, ret)
+		__field(u64, ns)
+	),
+
+	TP_fast_assign(
+		__assign_str(dev, dev_name(dev));
+		__entry->reg = reg;
+		__entry->bytes = bytes;
+		__entry->ret = ret;
+		__entry->ns = ns;
+	),
+
+	TP_printk("%s reg=0x%02x bytes=%u ret=%d ns=%llu",
+		  __get_str(dev), __entry->reg, __entry->bytes, __entry->ret,
+		  __entry->ns)
+);
+
+DEFINE_EVENT(bq27xxx_reg, bq27xxx_reg_read,
+	TP_PROTO(struct device *dev, u8 reg, size_t bytes, int ret, u64 ns),
+	TP_ARGS(dev, reg, bytes, ret, ns)
+);
+
+DEFINE_EVENT(bq27xxx_reg, bq27xxx_reg_write,
+	TP_PROTO(struct device *dev, u8 reg, size_t bytes, int ret, u64 ns),
+	TP_ARGS(dev, reg, bytes, ret, ns)
+);
+
+TRACE_EVENT(bq27xxx_update_begin,
+
+	TP_PROTO(struct device *dev),
+
+	TP_ARGS(dev),
+
+	TP_STRUCT__entry(
+		__string(dev, dev_name(dev))
+	),
+
+	TP_fast_assign(
+		__assign_str(dev, dev_name(dev));
+	),
+
+	TP_printk("%s", __get_str(dev))
+);
+
+/* @mask has BIT(enum bq27xxx_event_field) set for each changed field */
+TRACE_EVENT(bq27xxx_update_end,
+
+	TP_PROTO(struct device *dev, u64 seq, u32 mask, int flags),
+
+	TP_ARGS(dev, seq, mask, flags),
+
+	TP_STRUCT__entry(
+		__string(dev, dev_name(dev))
+		__field(u64, seq)
+		__field(u32, mask)
+		__field(int, flags)
+	),
+
+	TP_fast_assign(
+		__assign_str(dev, dev_name(dev));
+		__entry->seq = seq;
+		__entry->mask = mask;
+		__entry->flags = flags;
+	),
+
+	TP_printk("%s seq=%llu mask=0x%x flags=0x%04x", __get_str(dev),
+		  __entry->seq, __entry->mask, __entry->flags)
+);
+
+TRACE_EVENT(bq27xxx_irq,
+
+	TP_PROTO(struct device *dev, unsigned int count, bool coalesced),
+
+	TP_ARGS(dev, count, coalesced),
+
+	TP_STRUCT__entry(
+		__string(dev, dev_name(dev))
+		__field(unsigned int, count)
+		__field(bool, coalesced)
+	),
+
+	TP_fast_assign(
+		__assign_str(dev, dev_name(dev));
+		__entry->count = count;
+		__entry->coalesced = coalesced;
+	),
+
+	TP_printk("%s count=%u coalesced=%d", __get_str(dev),
+		  __entry->count, __entry->coalesced)
+);
+
+#endif /* _BQ27XXX_TRACE_H */
+
+#undef TRACE_INCLUDE_PATH
+#define TRACE_INCLUDE_PATH .
+#undef TRACE_INCLUDE_FILE
+#define TRACE_INCLUDE_FILE bq27xxx_trace
+#include <trace/define_trace.h>
@@ -0,0 +1,134 @@
+/*
+ * Read a bq27xxx gauge snapshot through the mmap()ed snapshot_page, and
+ * optionally compare the cost against read() of the snapshot attribute.
+ *
+ *   bq27xxx_snapread <device sysfs dir> [iterations]
+ *
+ * e.g. bq27xxx_snapread /sys/class/power_supply/bq27421-0/device 1000000
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "../bq27xxx_snapshot.h"
+
+static void snapshot_copy(const volatile struct bq27xxx_snapshot_page *page,
+			  struct bq27xxx_snapshot *snap)
+{
+	__u32 seq;
+
+	for (;;) {
+		seq = __atomic_load_n(&page->seq, __ATOMIC_ACQUIRE);
+		if (seq & 1)
+			continue;
+
+		memcpy(snap, (const void *)&page->snap, sizeof(*snap));
+
+		__atomic_thread_fence(__ATOMIC_ACQUIRE);
+		if (__atomic_load_n(&page->seq, __ATOMIC_RELAXED) == seq)
+			return;
+	}
+}
+
+static double now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static void snapshot_print(const struct bq27xxx_snapshot *snap)
+{
+	printf("version %u size %u seq %llu timestamp_ns %llu\n",
+	       snap->version, snap->size, (unsigned long long)snap->seq,
+	       (unsigned long long)snap->timestamp_ns);
+	printf("flags 0x%04x status %d health %d capacity %d%%\n",
+	       snap->flags, snap->status, snap->health, snap->capacity);
+	printf("voltage %d uV current %d uA temp %d.%d C\n",
+	       snap->voltage_uv, snap->current_ua,
+	       snap->temp / 10, abs(snap->temp % 10));
+	printf("charge now %d full %d design %d uAh cycles %d\n",
+	       snap->charge_now_uah, snap->charge_full_uah,
+	       snap->charge_full_design_uah, snap->cycle_count);
+}
+
+int main(int argc, char **argv)
+{
+	const struct bq27xxx_snapshot_page *page;
+	struct bq27xxx_snapshot snap;
+	char path[4096];
+	long i, iterations = 0;
+	double start, mmap_ns, read_ns;
+	int fd;
+
+	if (argc < 2) {
+		fprintf(stderr, "usage: %s <device sysfs dir> [iterations]\n",
+			argv[0]);
+		return 1;
+	}
+	if (argc > 2)
+		iterations = atol(argv[2]);
+
+	snprintf(path, sizeof(path), "%s/snapshot_page", argv[1]);
+	fd = open(path, O_RDONLY);
+	if (fd < 0) {
+		fprintf(stderr, "%s: %s\n", path, strerror(errno));
+		return 1;
+	}
+
+	page = mmap(NULL, sysconf(_SC_PAGESIZE), PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if (page == MAP_FAILED) {
+		fprintf(stderr, "mmap %s: %s\n", path, strerror(errno));
+		return 1;
+	}
+
+	snapshot_copy(page, &snap);
+	if (snap.version != BQ27XXX_SNAPSHOT_VERSION) {
+		fprintf(stderr, "unknown snapshot version %u\n", snap.version);
+		return 1;
+	}
+	snapshot_print(&snap);
+
+	if (!iterations)
+		return 0;
+
+	start = now_ns();
+	for (i = 0; i < iterations; i++)
+		snapshot_copy(page, &snap);
+	mmap_ns = (now_ns() - start) / iterations;
+
+	snprintf(path, sizeof(path), "%s/snapshot", argv[1]);
+	fd = open(path, O_RDONLY);
+	if (fd < 0) {
+		fprintf(stderr, "%s: %s\n", path, strerror(errno));
+		return 1;
+	}
+
+	start = now_ns();
+	for (i = 0; i < iterations; i++) {
+		if (pread(fd, &snap, sizeof(snap), 0) != sizeof(snap)) {
+			fprintf(stderr, "read %s: %s\n", path, strerror(errno));
+			return 1;
+		}
+	}
+	read_ns = (now_ns() - start) / iterations;
+	close(fd);
+
+	printf("%ld iterations: mmap %.1f ns/read, read() %.1f ns/read\n",
+	       iterations, mmap_ns, read_ns);
+
+	return 0;
+}